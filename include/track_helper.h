@@ -36,7 +36,8 @@ public:
 
     cv::Mat current_cHp;
 
-    // Downsample Scale
+    // Downsample Scale: the tracker detects on the image downsampled
+    // 'img_scale' times, the points are refined at full resolution
     unsigned int img_scale;
 
     // --- Pattern Tracker ---
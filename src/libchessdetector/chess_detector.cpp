@@ -1,6 +1,92 @@
 #include "chess_detector.h"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	// Computes the ChESS response of one band of rows per range index,
+	// with the radius 5 or 10 ring, optionally of the 5x5 box blurred image
+	// (radius 5 only), and each band's maximum and number of pixels
+	// skipped by the contrast gate
+	class ResponseBands : public cv::ParallelLoopBody
+	{
+	public:
+		ResponseBands(int w, int h, int n_bands, const uint8_t *img, size_t img_stride,
+			int16_t *resp, size_t resp_stride, int ring, bool blur, uint8_t *scratch, int gate,
+			int16_t *band_max, size_t *band_skipped) :
+			m_w(w), m_h(h), m_n_bands(n_bands), m_img(img), m_img_stride(img_stride),
+			m_resp(resp), m_resp_stride(resp_stride), m_ring(ring), m_blur(blur), m_scratch(scratch),
+			m_gate(gate), m_band_max(band_max), m_band_skipped(band_skipped) {}
+
+		virtual void operator()(const cv::Range &range) const
+		{
+			for (int b = range.start; b < range.end; b++)
+			{
+				if (m_ring == 10)
+					m_band_max[b] = corner_detect10_rows(m_w, m_h, m_img, m_img_stride, m_resp, m_resp_stride,
+						m_h * b / m_n_bands, m_h * (b + 1) / m_n_bands,
+						m_scratch + b * corner_detect10_scratch_size(m_w), m_gate, &m_band_skipped[b]);
+				else if (m_blur)
+					m_band_max[b] = corner_detect5_blur_rows(m_w, m_h, m_img, m_img_stride, m_resp, m_resp_stride,
+						m_h * b / m_n_bands, m_h * (b + 1) / m_n_bands,
+						m_scratch + b * corner_detect5_blur_scratch_size(m_w), m_gate, &m_band_skipped[b]);
+				else
+					m_band_max[b] = corner_detect5_rows(m_w, m_h, m_img, m_img_stride, m_resp, m_resp_stride,
+						m_h * b / m_n_bands, m_h * (b + 1) / m_n_bands, m_gate, &m_band_skipped[b]);
+			}
+		}
+
+	private:
+		int m_w, m_h, m_n_bands;
+		const uint8_t *m_img;
+		size_t m_img_stride;
+		int16_t *m_resp;
+		size_t m_resp_stride;
+		int m_ring;
+		bool m_blur;
+		uint8_t *m_scratch;	// one line buffer set per band
+		int m_gate;
+		int16_t *m_band_max;
+		size_t *m_band_skipped;
+	};
+
+	// Searches one band of rows of the response for candidate maxima.
+	// The search window reaches into neighbouring bands (halo rows),
+	// so the whole response must be complete before this runs.
+	class SearchBands : public cv::ParallelLoopBody
+	{
+	public:
+		SearchBands(int w, int h, int n_bands, int16_t *resp, size_t resp_stride,
+			int border, unsigned radius, int thresh, bool use_com,
+			consider_point *cp, int band_capacity, int *found) :
+			m_w(w), m_h(h), m_n_bands(n_bands), m_resp(resp), m_resp_stride(resp_stride),
+			m_border(border), m_radius(radius), m_thresh(thresh), m_use_com(use_com),
+			m_cp(cp), m_band_capacity(band_capacity), m_found(found) {}
+
+		virtual void operator()(const cv::Range &range) const
+		{
+			for (int b = range.start; b < range.end; b++)
+				m_found[b] = non_max_sup_search(m_w, m_h, m_resp_stride, m_resp, m_border, m_radius, m_thresh, m_use_com,
+					m_h * b / m_n_bands, m_h * (b + 1) / m_n_bands,
+					m_cp + b * m_band_capacity, m_band_capacity);
+		}
+
+	private:
+		int m_w, m_h, m_n_bands;
+		int16_t *m_resp;
+		size_t m_resp_stride;
+		int m_border;
+		unsigned m_radius;
+		int m_thresh;
+		bool m_use_com;
+		consider_point *m_cp;
+		int m_band_capacity;
+		int *m_found;
+	};
+}
 
 
 ChessDetector::Params::Params()
@@ -9,34 +95,51 @@ ChessDetector::Params::Params()
 	neighbourhood = 20;
 	estimateOrientation = true;
 	filterMinorOrientation = true;
+	numThreads = 0;
+	blurInput = false;
+	fusedBlur = true;
+	useCentreOfMass = false;
+	contrastGate = 0;
+	ringRadius = 5;
+	pyramidLevels = 0;
 }
 
 ChessDetector::ChessDetector(const ChessDetector::Params &parameters) :
 	m_points (NULL),
 	m_img (NULL),
+	m_img_stride (0),
 	m_resp (NULL),
-	m_resp_init (false),
+	m_resp_stride (0),
 	m_img_width (0),
 	m_img_height (0),
 	m_orient (1000),
+	m_orient_confidence (0.f),
+	m_skipped (0),
 	params(parameters)
 {
-	
+	std::fill(m_ori_hist, m_ori_hist + 8, 0);
 }
 
 ChessDetector::~ChessDetector()
 {
-	if (m_resp_init)
-	{
-		delete [] m_resp;
-		m_resp = NULL;
-		m_resp_init = false;
-	}
+	free_point_list(m_points);
+	m_points = NULL;
+}
 
+bool ChessDetector::detect(
+	cv::InputArray in_image, 
+	std::vector<cv::Point2f> &out_points,
+	std::vector<cv::Point2f> &all_chess_points,
+	const int &thresh_outlier)
+{
+	cv::Size size = in_image.size();
+	return detect(in_image, cv::Rect(0, 0, size.width, size.height),
+		out_points, all_chess_points, thresh_outlier);
 }
 
 bool ChessDetector::detect(
 	cv::InputArray in_image, 
+	const cv::Rect &roi,
 	std::vector<cv::Point2f> &out_points,
 	std::vector<cv::Point2f> &all_chess_points,
 	const int &thresh_outlier)
@@ -44,10 +147,17 @@ bool ChessDetector::detect(
 	out_points.clear();	// Make sure out_point.size() == 0
 	std::vector<cv::Point2f> temp_out_points;
 
+	std::fill(m_ori_hist, m_ori_hist + 8, 0);
+	m_orient_confidence = 0.f;
+	m_skipped = 0;
+
 	cv::Mat image = in_image.getMat();
 	cv::Mat grayscaleImage;
 	if (image.channels() == 3)
-		cv::cvtColor(image, grayscaleImage, cv::COLOR_BGR2GRAY);
+	{
+		cv::cvtColor(image, m_gray, cv::COLOR_BGR2GRAY);
+		grayscaleImage = m_gray;
+	}
 	else
 		grayscaleImage = image;
 
@@ -55,97 +165,125 @@ bool ChessDetector::detect(
 		std::cerr << "Blob detector only supports 8-bit images!" << std::endl;;
 	}
 
-	m_img = (uint8_t*) grayscaleImage.data;
-
-	if (!m_resp_init)
+	const cv::Rect window = roi & cv::Rect(0, 0, grayscaleImage.cols, grayscaleImage.rows);
+	if (window.empty())
 	{
-		m_img_width = image.cols;
-		m_img_height = image.rows;
-		m_resp = new int16_t[m_img_width * m_img_height];
-		m_resp_init = true;
+		m_orient = 1000;	// invalid value
+		return false;
 	}
+	const cv::Point2f offset (window.x, window.y);
 
-	memset(m_resp, 0, m_img_width * m_img_height * 2);
-	corner_detect5(m_img_width, m_img_height, m_img, m_resp);
-
-	int16_t max_resp = 0;
-	for (unsigned px = 0; px < m_img_width * m_img_height; px++)
-		if (m_resp[px] > max_resp)
-			max_resp = m_resp[px];
-
-	// TODO: DELETE
-// 	cv::Mat resp_norm;
-// 	cv::Mat resp_mat (m_img_height, m_img_width, CV_16UC1);
-// 	for (auto i = 0; i < m_img_height; i++)
-// 	{
-// 		for (auto j = 0; j < m_img_width; j++)
-// 		{
-// 			if (m_resp[i*m_img_width+j] < 10)
-// 			{
-// 				resp_mat.at<int16_t>(i, j) = 0;
-// 			} 
-// 			else
-// 			{
-// 				resp_mat.at<int16_t>(i, j) = m_resp[i*m_img_width+j];
-// 			}
-// 			
-// 		}
-// 	}
-// 	cv::normalize(resp_mat, resp_norm, 10, 255, cv::NORM_MINMAX, CV_8UC1);
-// 	cv::Mat resp_norm_inv =  cv::Scalar::all(255) - resp_norm;
-// 	cv::imwrite("resp_map.png",resp_norm_inv);
+	const int ring = params.ringRadius == 10 ? 10 : 5;
+	const int level = std::min(std::max(params.pyramidLevels, 0), 2);
 
-	unsigned thresh = max_resp >> 1;
+	// With the fused blur, m_img is the unblurred image.  The radius 10
+	// ring has no fused kernel, but refinement and orientation only blur
+	// patches, so that is only an issue without the pyramid
+	const bool fused_blur = params.blurInput && params.fusedBlur && (ring == 5 || level > 0);
 
-	if (max_resp > 250)
+	// The window is used in place, whatever its row stride
+	cv::Mat windowImage = grayscaleImage(window);
+	if (params.blurInput && !fused_blur)
 	{
-		if (non_max_sup_pts(m_img_width, m_img_height,
-			m_resp, 7, params.radius, thresh, 0, params.neighbourhood,
-			&new_point_list, &append_pl_point,
-			(void **)&m_points) < 1)
-		{
-			m_orient = 1000;	// invalid value
-			return false;
-		}
+		cv::blur(windowImage, m_window, cv::Size(5, 5));
+		windowImage = m_window;
+	}
+
+	m_img = (uint8_t*) windowImage.data;
+	m_img_stride = windowImage.step;
+	m_img_width = window.width;
+	m_img_height = window.height;
+
+	bool found;
+	if (level > 0)
+	{
+		// Coarse to fine: radius 5 ring on the downsampled (unblurred, area
+		// averaging is the low-pass) window, then each hit is refined at
+		// full resolution
+		const int scale = 1 << level;
+		cv::resize(grayscaleImage(window), m_coarse,
+			cv::Size(window.width / scale, window.height / scale), 0, 0, cv::INTER_AREA);
+		found = m_coarse.cols > 0 && m_coarse.rows > 0 &&
+			detectPoints(m_coarse.data, m_coarse.step, m_coarse.cols, m_coarse.rows, 5, false,
+			std::max(params.radius >> level, 2u), std::max(params.neighbourhood >> level, 2u)) &&
+			refinePoints((float)window.width / m_coarse.cols, (float)window.height / m_coarse.rows,
+			scale + 1, ring, fused_blur);
+	}
+	else
+		found = detectPoints(m_img, m_img_stride, m_img_width, m_img_height, ring, fused_blur,
+			params.radius, params.neighbourhood);
 
+	if (found)
+	{
 		// Orientation
 		if (params.estimateOrientation)
 		{
-			for (int i = 0; i < m_points->occupancy; i++)
-				m_points->point[i].ori = 
-				assign_orientation(m_img_width, m_img, 
-				cvRound(m_points->point[i].pos.x - .5f) 
-				+ cvRound(m_points->point[i].pos.y - .5f) * m_img_width, 1);
+			const int sz = m_points->occupancy;
+			if ((int)m_ori.size() < sz)
+			{
+				m_ori.resize(sz);
+				m_ori_offsets.resize(sz);
+			}
 
-			if (params.filterMinorOrientation)
+			// Sampling ring of the detection radius (multiple of 5 px)
+			const int ori_r = ring / 5;
+			const int side = 10 * ori_r + 1;
+
+			// No blurred image to sample in fused mode, blur the ring's
+			// patch of every point into a strip of patches instead
+			const uint8_t *ori_img = m_img;
+			size_t ori_stride = m_img_stride;
+			if (fused_blur)
 			{
-				auto sz = m_points->occupancy;
-				auto count = 0, max_count = 0;
-				int majorOrient;
-				int *ori = new int[sz];
-				for (int i=0;i<sz;i++)
-					ori[i] = m_points->point[i].ori;
-
-				for (auto i = 0; i < sz; i++)
+				if (m_ori_patches.size() < (size_t)sz * side * side)
+					m_ori_patches.resize(sz * side * side);
+				ori_img = &m_ori_patches[0];
+				ori_stride = side;
+			}
+
+			for (int i = 0; i < sz; i++)
+			{
+				const int x = cvRound(m_points->point[i].pos.x - .5f);
+				const int y = cvRound(m_points->point[i].pos.y - .5f);
+				if (fused_blur)
 				{
-					int count=1;
-					for (auto j = i+1; j < sz; j++)
-						if (ori[i]==ori[j])
-							count++;
-					if (count>max_count)
-					{
-						max_count = count;
-						majorOrient = ori[i];
-					}
+					box_blur5_patch(m_img_width, m_img_height, m_img, m_img_stride, x, y, 5 * ori_r,
+						&m_ori_patches[i * side * side]);
+					m_ori_offsets[i] = i * side * side + 5 * ori_r * (side + 1);
 				}
+				else
+					m_ori_offsets[i] = x + y * m_img_stride;
+			}
+
+			assign_orientations(ori_stride, ori_img, &m_ori_offsets[0], sz, ori_r, &m_ori[0], m_ori_hist);
 
-				delete [] ori;
+			// Majority orientation: the most frequent bin,
+			// the one seen first on ties
+			int first[8] = {sz, sz, sz, sz, sz, sz, sz, sz};
+			for (int i = sz - 1; i >= 0; i--)
+			{
+				m_points->point[i].ori = m_ori[i];
+				first[m_ori[i] + 4] = i;
+			}
+			int major_bin = 0;
+			for (int b = 1; b < 8; b++)
+				if (m_ori_hist[b] > m_ori_hist[major_bin] ||
+					(m_ori_hist[b] == m_ori_hist[major_bin] && first[b] < first[major_bin]))
+					major_bin = b;
+			const int majorOrient = major_bin - 4;
 
+			// Points kept by the minor orientation filter
+			const int similar = m_ori_hist[major_bin] + m_ori_hist[(major_bin + 1) & 7] +
+				m_ori_hist[(major_bin + 7) & 7];
+			m_orient_confidence = (float)similar / sz;
+
+			if (params.filterMinorOrientation)
+			{
 				for (auto i = 0; i <sz; i++)
 				{
 					if (similar_orientation(m_points->point[i].ori, majorOrient))
 						temp_out_points.push_back(cv::Point2f(m_points->point[i].pos.x,
-						m_points->point[i].pos.y));
+						m_points->point[i].pos.y) + offset);
 				}
 
 				m_orient = majorOrient;
@@ -158,7 +296,7 @@ bool ChessDetector::detect(
 			temp_out_points.reserve(m_points->occupancy);
 			for (int i = 0; i < m_points->occupancy; i++)
 			{
-				cv::Point pt (m_points->point[i].pos.x, m_points->point[i].pos.y);
+				cv::Point pt (m_points->point[i].pos.x + offset.x, m_points->point[i].pos.y + offset.y);
 				temp_out_points.push_back(pt);
 			}
 		}
@@ -174,8 +312,8 @@ bool ChessDetector::detect(
 		all_chess_points.resize(m_points->occupancy);
 		for (int i = 0; i < m_points->occupancy; i++)
 		{
-			all_chess_points[i].x = m_points->point[i].pos.x;
-			all_chess_points[i].y = m_points->point[i].pos.y;
+			all_chess_points[i].x = m_points->point[i].pos.x + offset.x;
+			all_chess_points[i].y = m_points->point[i].pos.y + offset.y;
 		}
 	}
 	else
@@ -187,53 +325,212 @@ bool ChessDetector::detect(
 	// Filter outliers based on specified threshold
 	if (thresh_outlier > 0)
 	{
-		// Apply partition 
-		// All pixels within the radius tolerance distance 
-		// will belong to the same class (same label)
-		std::vector<int> labels;
-
-		// With lambda function (require C++11)
-		int th2 = thresh_outlier * thresh_outlier;
-		int n_labels = cv::partition(temp_out_points, labels, [th2](const cv::Point2f& lhs, const cv::Point2f& rhs) {
-			return ((lhs.x - rhs.x)*(lhs.x - rhs.x) + (lhs.y - rhs.y)*(lhs.y - rhs.y)) < th2;
-		});
-
-		// Find majority (largest) cluster
-		if (n_labels == 1)
-			out_points = temp_out_points;
-		else
+		// All points within the tolerance distance of each other
+		// (transitively) belong to the same cluster.
+		// Keep the largest cluster if it holds at least half the points
+		const PointClusterer::Cluster major =
+			m_clusterer.largest(temp_out_points, (float)thresh_outlier, out_points);
+		if (major.size < (int)temp_out_points.size() / 2)
+			out_points.clear();
+	}
+	else
+		out_points = temp_out_points;
+	return true;
+}
+
+bool ChessDetector::detectPoints(const uint8_t *img, size_t img_stride, int w, int h,
+	int ring, bool fused_blur, unsigned radius, unsigned neighbourhood)
+{
+	ResponsePool::Buffer resp = m_resp_pool.acquire(w, h);
+	m_resp = resp.data;
+	m_resp_stride = resp.stride;
+
+	const int n_bands = bandCount(h);
+
+	// The kernels write every pixel, border included, and return
+	// the maximum of their band, so the response is touched only once
+	m_band_max.assign(n_bands, 0);
+	m_band_skipped.assign(n_bands, 0);
+	const size_t scratch_size = ring == 10 ? corner_detect10_scratch_size(w) :
+		fused_blur ? corner_detect5_blur_scratch_size(w) : 0;
+	if (m_line_scratch.size() < n_bands * scratch_size)
+		m_line_scratch.resize(n_bands * scratch_size);
+	cv::parallel_for_(cv::Range(0, n_bands),
+		ResponseBands(w, h, n_bands, img, img_stride, m_resp, m_resp_stride, ring, fused_blur,
+		scratch_size ? &m_line_scratch[0] : NULL, params.contrastGate,
+		&m_band_max[0], &m_band_skipped[0]), n_bands);
+
+	const int16_t max_resp = *std::max_element(m_band_max.begin(), m_band_max.end());
+	m_skipped = std::accumulate(m_band_skipped.begin(), m_band_skipped.end(), (size_t)0);
+
+	if (max_resp <= 250)
+		return false;
+
+	unsigned thresh = max_resp >> 1;
+
+	// Each band gets the capacity of the whole image, so merging the
+	// bands in row order and truncating reproduces the single-band list
+	const int band_capacity = non_max_sup_reserve(&m_nms, w, h, radius, n_bands);
+	consider_point *candidates = &m_nms.cp[0];
+
+	// no response closer than the ring and blur border to the edge
+	const int border = ring == 10 ? 14 : 7;
+
+	m_band_found.assign(n_bands, 0);
+	cv::parallel_for_(cv::Range(0, n_bands),
+		SearchBands(w, h, n_bands, m_resp, m_resp_stride, border,
+		radius, thresh, params.useCentreOfMass, candidates, band_capacity, &m_band_found[0]), n_bands);
+
+	int num_found = 0;
+	for (int b = 0; b < n_bands && num_found < band_capacity; b++)
+	{
+		int n = std::min(std::max(m_band_found[b], 0), band_capacity - num_found);
+		if (n > 0 && b > 0)
+			std::copy(candidates + b * band_capacity,
+				candidates + b * band_capacity + n,
+				candidates + num_found);
+		num_found += n;
+	}
+
+	// The point list is kept and reused from frame to frame
+	return num_found > 0 && reserve_point_list((void **)&m_points, num_found) &&
+		non_max_sup_finish(m_resp_stride, m_resp, thresh, params.useCentreOfMass, neighbourhood,
+		candidates, num_found, &m_nms,
+		&append_pl_point, m_points) > 0;
+}
+
+bool ChessDetector::refinePoints(float scale_x, float scale_y, int half, int ring, bool fused_blur)
+{
+	// Patch around each point: the search window, 2 more pixels for the
+	// 5x5 CoM, and the border without response
+	const int border = ring == 10 ? 14 : 7;
+	const int side = 2 * (half + 2 + border) + 1;
+	if (side > m_img_width || side > m_img_height)
+		return false;
+
+	if (m_refine_resp.size() < (size_t)side * side)
+	{
+		m_refine_resp.resize(side * side);
+		m_refine_patch.resize(side * side);
+	}
+	if (ring == 10 && m_line_scratch.size() < corner_detect10_scratch_size(side))
+		m_line_scratch.resize(corner_detect10_scratch_size(side));
+
+	int kept = 0;
+	for (int i = 0; i < m_points->occupancy; i++)
+	{
+		// pixel centres are at 0.5 at both scales
+		const int cx = (int)(m_points->point[i].pos.x * scale_x);
+		const int cy = (int)(m_points->point[i].pos.y * scale_y);
+
+		// patch inside the window, searched only where the response is
+		// valid and the CoM stays inside the patch
+		const int px = std::min(std::max(cx - side / 2, 0), m_img_width - side);
+		const int py = std::min(std::max(cy - side / 2, 0), m_img_height - side);
+		const int x0 = std::max(cx - half, px + border + 2) - px;
+		const int y0 = std::max(cy - half, py + border + 2) - py;
+		const int x1 = std::min(cx + half + 1, px + side - border - 2) - px;
+		const int y1 = std::min(cy + half + 1, py + side - border - 2) - py;
+		if (x0 >= x1 || y0 >= y1)
+			continue;
+
+		// Same pixels as the full resolution response would see
+		const uint8_t *src = m_img + py * m_img_stride + px;
+		size_t src_stride = m_img_stride;
+		if (fused_blur)
 		{
-			// Moore's voting algorithm for finding majority (more than half) elements
-			auto sz = temp_out_points.size();
-			auto count = 0;
-			int majorityLabel;
-			for (auto i = 0; i < sz; i++) {
-				if (count == 0)
-					majorityLabel = labels[i];
-				if (labels[i] == majorityLabel)
-					count++;
-				else
-					count--;
-			}
-			// Check indeed is majority
-			count = 0;
-			for (auto i = 0; i < sz; i++)
-				if (labels[i] == majorityLabel)
-					count++;
-			
-			// May not be necessary to check
-			if (count >= sz/2)
-			{
-				out_points.reserve(count);
-				for (auto i = 0; i < sz; i++)
-				{
-					if (labels[i] == majorityLabel)
-						out_points.push_back(temp_out_points[i]);
-				}
-			}
+			box_blur5_patch(m_img_width, m_img_height, m_img, m_img_stride,
+				px + side / 2, py + side / 2, side / 2, &m_refine_patch[0]);
+			src = &m_refine_patch[0];
+			src_stride = side;
 		}
+
+		if (ring == 10)
+			corner_detect10_rows(side, side, src, src_stride, &m_refine_resp[0], side, 0, side, &m_line_scratch[0]);
+		else
+			corner_detect5_rows(side, side, src, src_stride, &m_refine_resp[0], side, 0, side);
+
+		fcoord pos;
+		if (!non_max_sup_peak(side, &m_refine_resp[0], x0, y0, x1, y1, &pos))
+			continue;
+
+		m_points->point[kept].pos.x = pos.x + px;
+		m_points->point[kept].pos.y = pos.y + py;
+		kept++;
+	}
+	m_points->occupancy = kept;
+
+	return kept > 0;
+}
+
+bool ChessDetector::refine(cv::InputArray in_image, float scale, std::vector<cv::Point2f> &points)
+{
+	if (points.empty() || scale <= 1.f)
+		return !points.empty();
+
+	const int ring = params.ringRadius == 10 ? 10 : 5;
+	const int half = cvCeil(scale) + 1;
+	const int side = 2 * (half + 2 + (ring == 10 ? 14 : 7)) + 1;
+
+	// Window of the patches of all points, the blur border included
+	cv::Mat image = in_image.getMat();
+	cv::Rect box = cv::boundingRect(points);
+	box.x -= side / 2 + 2;
+	box.y -= side / 2 + 2;
+	box.width += side + 4;
+	box.height += side + 4;
+	const cv::Rect window = box & cv::Rect(0, 0, image.cols, image.rows);
+	if (window.width < side || window.height < side)
+		return false;
+
+	cv::Mat windowImage;
+	if (image.channels() == 3)
+	{
+		cv::cvtColor(image(window), m_gray, cv::COLOR_BGR2GRAY);
+		windowImage = m_gray;
 	}
 	else
-		out_points = temp_out_points;
+		windowImage = image(window);
+
+	const bool fused_blur = params.blurInput && params.fusedBlur;
+	if (params.blurInput && !fused_blur)
+	{
+		cv::blur(windowImage, m_window, cv::Size(5, 5));
+		windowImage = m_window;
+	}
+
+	m_img = (uint8_t*) windowImage.data;
+	m_img_stride = windowImage.step;
+	m_img_width = window.width;
+	m_img_height = window.height;
+
+	const int n = (int)points.size();
+	if (!reserve_point_list((void **)&m_points, n))
+		return false;
+	for (int i = 0; i < n; i++)
+	{
+		m_points->point[i].pos.x = (points[i].x - window.x) / scale;
+		m_points->point[i].pos.y = (points[i].y - window.y) / scale;
+	}
+	m_points->occupancy = n;
+
+	if (!refinePoints(scale, scale, half, ring, fused_blur))
+		return false;
+
+	points.resize(m_points->occupancy);
+	for (int i = 0; i < m_points->occupancy; i++)
+		points[i] = cv::Point2f(m_points->point[i].pos.x + window.x, m_points->point[i].pos.y + window.y);
 	return true;
-}
\ No newline at end of file
+}
+
+void ChessDetector::OrientationHistogram(int hist[8]) const
+{
+	std::copy(m_ori_hist, m_ori_hist + 8, hist);
+}
+
+int ChessDetector::bandCount(int rows) const
+{
+	int n = params.numThreads > 0 ? params.numThreads : cv::getNumThreads();
+	// Keep bands tall compared to the search halo
+	return std::max(1, std::min(n, rows / 32));
+}
@@ -11,10 +11,13 @@
 
 
 #include <opencv2/core.hpp>
+#include <vector>
 #include "chess_features.h"
 #include "corner_detect.h"
 #include "non_max_sup_pts.h"
 #include "feature_orientation.h"
+#include "response_pool.h"
+#include "point_clusterer.h"
 
 
 class ChessDetector
@@ -30,6 +33,40 @@ public:
 
 		// Flag to filter points has minority orientation
 		bool filterMinorOrientation;
+
+		// Number of horizontal bands the response and non-maximum
+		// suppression are split into and run in parallel.
+		// 0: one band per OpenCV worker thread, 1: single-threaded
+		int numThreads;
+
+		// Apply a 5x5 box blur (as cv::blur) to the input before detection
+		bool blurInput;
+
+		// With 'blurInput', blur inside the response kernel from a rolling
+		// line buffer instead of writing a blurred copy of the image first.
+		// false: reference mode, cv::blur then the response (same result)
+		bool fusedBlur;
+
+		// Localize points at the centre of mass of their connected response
+		// (15x15 window) instead of the 5x5 patch around the maximum.
+		// Also enables culling on the response mass
+		bool useCentreOfMass;
+
+		// Skip the response of blocks of pixels whose sampling ring has
+		// less contrast (grey levels) than this, they are set to zero.
+		// Pays off once most of the frame is gated out, ~25 and above
+		// for smooth tissue. 0: compute every pixel
+		int contrastGate;
+
+		// Radius of the ChESS sampling ring: 5, or 10 for large features
+		// (close-ups). The radius 10 ring has no fused blur kernel.
+		int ringRadius;
+
+		// Coarse to fine detection: 0 full resolution only, 1 (2) detect
+		// at half (quarter) resolution with the radius 5 ring, then refine
+		// each hit at full resolution with 'ringRadius' in a small window.
+		// 'radius' and 'neighbourhood' are scaled down for the coarse level
+		int pyramidLevels;
 	};
 
 	ChessDetector(const ChessDetector::Params &parameters = ChessDetector::Params());
@@ -45,26 +82,107 @@ public:
 		std::vector<cv::Point2f> &all_chess_points,
 		const int &thresh_outlier = 0);
 
+	// Same as above, but the response and non-maximum suppression
+	// are only computed inside 'roi' (clipped to the image).
+	// Output points are in full image coordinates.
+	// Features closer than ~10 pixels to the 'roi' border are missed,
+	// so pad the window accordingly.
+	bool detect(cv::InputArray image,
+		const cv::Rect &roi,
+		std::vector<cv::Point2f> &points,
+		std::vector<cv::Point2f> &all_chess_points,
+		const int &thresh_outlier = 0);
+
+	// Move 'points', detected on 'image' downsampled 'scale' times and
+	// already mapped to its resolution (pixel centres at 0.5, as for all
+	// points of the detector), to the response peak within 'scale' + 1
+	// pixels. Only the window around them is converted to grayscale.
+	// Points without a peak there are dropped; if none has one, they are
+	// left as they are and false is returned. Replaces the points of the
+	// last detection (orientation is kept)
+	bool refine(cv::InputArray image, float scale, std::vector<cv::Point2f> &points);
+
 	// Return true if orientation is valid, false otherwise
 	inline bool Orientation(int &ori) {
 		ori = m_orient;
 		return (ori > 3 || ori < -4) ? false : true; 
 	}
 
+	// Histogram of the orientations of all points of the last detection,
+	// bin 'ori + 4' for orientation 'ori' in [-4, 3].
+	// All zero if orientation was not estimated
+	void OrientationHistogram(int hist[8]) const;
+
+	// Fraction of the points of the last detection having an orientation
+	// similar (+/- 1 bin) to the majority one, 0 if not estimated
+	inline float OrientationConfidence() const { return m_orient_confidence; }
+
+	// Number of pixels of the last detection whose response was skipped
+	// by the contrast gate ('Params::contrastGate')
+	inline size_t SkippedPixels() const { return m_skipped; }
+
 private:
 
+	// Number of bands to split an image of 'rows' rows into
+	int bandCount(int rows) const;
+
+	// Response (into m_resp) and non-maximum suppression (into m_points) of
+	// a 'w' x 'h' image, false if nothing was found
+	bool detectPoints(const uint8_t *img, size_t img_stride, int w, int h,
+		int ring, bool fused_blur, unsigned radius, unsigned neighbourhood);
+
+	// Move m_points, found on an image 'scale_x' x 'scale_y' times smaller
+	// than m_img, to the response peak within 'half' pixels at full
+	// resolution. Points without a peak there are dropped.
+	bool refinePoints(float scale_x, float scale_y, int half, int ring, bool fused_blur);
+
 	// pointer to current image
 	uint8_t *m_img;
 
-	// pointer to current response map
+	// row stride of current image (bytes)
+	size_t m_img_stride;
+
+	// pointer to current response map, from m_resp_pool
 	int16_t *m_resp;
 
-	// list of point
+	// row stride of current response map (elements)
+	size_t m_resp_stride;
+
+	// response maps for the window sizes seen so far
+	ResponsePool m_resp_pool;
+
+	// grayscale conversion of colour input
+	cv::Mat m_gray;
+
+	// blurred window in reference blur mode
+	cv::Mat m_window;
+
+	// list of point, reused across frames
 	sized_point_list *m_points;
 
-	// is the response map is prelocated
-	bool m_resp_init;
+	// Non-maximum suppression storage: candidate maxima, one equally
+	// sized slice per band, and culling scratch
+	non_max_sup_workspace m_nms;
+
+	// Per band maximum response and number of candidates found
+	std::vector<int16_t> m_band_max;
+	std::vector<int> m_band_found;
+	std::vector<size_t> m_band_skipped;
+
+	// pixels skipped by the contrast gate in the last detection
+	size_t m_skipped;
 
+	// Line buffers of the fused blur or radius 10 kernel, one set per band
+	std::vector<uint8_t> m_line_scratch;
+
+	// downsampled window in pyramid mode
+	cv::Mat m_coarse;
+
+	// response and blurred pixels of the refinement patch in pyramid mode
+	std::vector<int16_t> m_refine_resp;
+	std::vector<uint8_t> m_refine_patch;
+
+	// size of the current detection window
 	int m_img_width;
 	int m_img_height;
 
@@ -73,6 +191,19 @@ private:
 	// Invalid values: 1000
 	int m_orient;
 
+	// Orientation histogram and confidence of the last detection
+	int m_ori_hist[8];
+	float m_orient_confidence;
+
+	// Orientation of each point, sampling offsets and
+	// blurred patches (fused blur) for the batched orientation
+	std::vector<int> m_ori;
+	std::vector<off_t> m_ori_offsets;
+	std::vector<uint8_t> m_ori_patches;
+
+	// outlier filter, clusters of chess points
+	PointClusterer m_clusterer;
+
 	Params params;
 };
 #endif		// CHESS_DETECTOR_H
\ No newline at end of file
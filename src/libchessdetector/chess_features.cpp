@@ -31,6 +31,46 @@ void *new_point_list(int n)
 	return spl;
 }
 
+/**
+ * Empties a point list and makes sure it can store n points.  The list's
+ * storage is reused when large enough, so a list kept across frames stops
+ * allocating once it has seen the largest frame
+ *
+ * @param	splv	in: the list (NULL for none yet), out: the emptied list
+ * @param	n	number of points the list is to store
+ * @return		boolean success (on failure the list is left untouched)
+ */
+bool reserve_point_list(void **splv, int n)
+{
+	struct sized_point_list *spl = static_cast<sized_point_list*>(*splv);
+
+	if (!spl || spl->capacity < n) {
+		// realloc keeps the indices already set
+		int initialized = spl ? spl->capacity : 0;
+		spl = static_cast<sized_point_list*>(realloc(spl, sizeof(struct sized_point_list) + n * sizeof(struct point)));
+		if (!spl)
+			return false;
+		for (int p = initialized; p < n; p++)
+			spl->point[p].idx = p;
+		spl->capacity = n;
+		*splv = spl;
+	}
+
+	spl->occupancy = 0;
+
+	return true;
+}
+
+/**
+ * Frees a point list created by new_point_list() or reserve_point_list()
+ *
+ * @param	splv	the point list, as an opaque pointer (may be NULL)
+ */
+void free_point_list(void *splv)
+{
+	free(splv);
+}
+
 /**
  * Adds a co-ordinate pair to a pre-existing point list
  *
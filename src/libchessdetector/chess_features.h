@@ -33,6 +33,8 @@ struct sized_point_list {
 };
 
 void *new_point_list(int n);
+bool reserve_point_list(void **plv, int n);
+void free_point_list(void *plv);
 bool append_pl_point(void *plv, struct fcoord *pos);
 
 #endif /* CHESS_FEATURES_H */
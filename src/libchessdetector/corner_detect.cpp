@@ -14,6 +14,11 @@
 
 #include <stdlib.h>	// abs
 #include <sys/types.h>	// off_t
+#include <algorithm>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /**
  * Our vector types
@@ -256,8 +261,554 @@
 //		}
 //}
 
+/**
+ * Row kernel type.  Computes the ChESS response for pixels [x0, x1) of one
+ * row, given pointers to the eleven image rows centred on it (row[5] is the
+ * row being processed, row[0] is 5 rows above), and returns the largest
+ * response written (0 if none is positive)
+ */
+typedef int16_t (*row_kernel_fn)(const uint8_t *const row[11], int16_t response[], size_t x0, size_t x1);
+
+/**
+ * Scalar reference row kernel.  Every vectorized kernel must match this
+ * bit for bit
+ *
+ * @param	row	the eleven image rows the sampling ring touches
+ * @param	response	output response row
+ * @param	x0	first pixel to compute
+ * @param	x1	one past the last pixel to compute
+ * @return		the largest response written, or 0
+ */
+static int16_t row_kernel_scalar(const uint8_t *const row[11], int16_t response[], size_t x0, size_t x1)
+{
+	int16_t max_response = 0;
+	size_t x;
+	for (x = x0; x < x1; x++) {
+		uint8_t circular_sample[16];
+
+		circular_sample[2] = row[0][x - 2];
+		circular_sample[1] = row[0][x];
+		circular_sample[0] = row[0][x + 2];
+		circular_sample[8] = row[10][x - 2];
+		circular_sample[9] = row[10][x];
+		circular_sample[10] = row[10][x + 2];
+		circular_sample[3] = row[1][x - 4];
+		circular_sample[15] = row[1][x + 4];
+		circular_sample[7] = row[9][x - 4];
+		circular_sample[11] = row[9][x + 4];
+		circular_sample[4] = row[3][x - 5];
+		circular_sample[14] = row[3][x + 5];
+		circular_sample[6] = row[7][x - 5];
+		circular_sample[12] = row[7][x + 5];
+		circular_sample[5] = row[5][x - 5];
+		circular_sample[13] = row[5][x + 5];
+
+		// purely horizontal local_mean samples
+		uint16_t local_mean = (row[5][x - 1] + row[5][x] + row[5][x + 1]) * 16 / 3;
+
+		uint16_t sum_response = 0;
+		uint16_t diff_response = 0;
+		uint16_t mean = 0;
+
+		int sub_idx;
+		for (sub_idx = 0; sub_idx < 4; ++sub_idx) {
+			uint8_t a = circular_sample[sub_idx];
+			uint8_t b = circular_sample[sub_idx + 4];
+			uint8_t c = circular_sample[sub_idx + 8];
+			uint8_t d = circular_sample[sub_idx + 12];
+
+			sum_response += abs(a - b + c - d);
+			diff_response += abs(a - c) + abs(b - d);
+			mean += a + b + c + d;
+		}
+
+		response[x] = sum_response - diff_response - abs(mean - local_mean);
+		if (response[x] > max_response)
+			max_response = response[x];
+	}
+
+	return max_response;
+}
+
+/*
+ * All intermediate quantities fit in 16 bits: sum/diff responses are at most
+ * 4 * 510, the ring mean and local mean at most 16 * 255.  The local mean's
+ * division by 3 is done as a multiply-high by ceil(2^16 / 3), which is exact
+ * for every numerator the kernel can produce (multiples of 16 up to 12240)
+ */
+#define LOCAL_MEAN_DIV3_MAGIC 21846
+
+#if defined(__GNUC__)
+
+/*
+ * Vector types for the portable variant, built on the compiler's generic
+ * vector extension; lowers to whatever SIMD the target baseline offers
+ */
+typedef int16_t v8hi __attribute__ ((vector_size(16)));
+typedef uint16_t v8hu __attribute__ ((vector_size(16)));
+
+static inline v8hi load_v8hi(const uint8_t *p)
+{
+	v8hi v;
+	for (int i = 0; i < 8; i++)
+		v[i] = p[i];
+	return v;
+}
+
+static inline v8hi abs_v8hi(v8hi v)
+{
+	return v < 0 ? -v : v;
+}
+
+/**
+ * Summation and differencing for one group of ring samples a quarter turn
+ * apart, accumulated into the running responses
+ */
+static inline void sd_vector(v8hi a, v8hi b, v8hi c, v8hi d,
+		v8hi *sum_response, v8hi *diff_response, v8hi *mean)
+{
+	*sum_response += abs_v8hi(a - b + c - d);
+	*diff_response += abs_v8hi(a - c) + abs_v8hi(b - d);
+	*mean += a + b + c + d;
+}
+
+/**
+ * Portable variant, 8 response pixels per iteration
+ */
+static int16_t row_kernel_vector(const uint8_t *const row[11], int16_t response[], size_t x0, size_t x1)
+{
+	v8hi max_response = { 0 };
+	size_t x = x0;
+	for (; x + 8 <= x1; x += 8) {
+		v8hi sum_response = { 0 };
+		v8hi diff_response = sum_response, mean = sum_response;
+
+		sd_vector(load_v8hi(&row[0][x + 2]), load_v8hi(&row[3][x - 5]),
+			load_v8hi(&row[10][x - 2]), load_v8hi(&row[7][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_vector(load_v8hi(&row[0][x]), load_v8hi(&row[5][x - 5]),
+			load_v8hi(&row[10][x]), load_v8hi(&row[5][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_vector(load_v8hi(&row[0][x - 2]), load_v8hi(&row[7][x - 5]),
+			load_v8hi(&row[10][x + 2]), load_v8hi(&row[3][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_vector(load_v8hi(&row[1][x - 4]), load_v8hi(&row[9][x - 4]),
+			load_v8hi(&row[9][x + 4]), load_v8hi(&row[1][x + 4]),
+			&sum_response, &diff_response, &mean);
+
+		// purely horizontal local_mean samples
+		v8hu local_mean = (v8hu)((load_v8hi(&row[5][x - 1]) + load_v8hi(&row[5][x])
+			+ load_v8hi(&row[5][x + 1])) << 4) / 3;
+
+		// reject stripe case by removing difference in means
+		v8hi final = sum_response - diff_response - abs_v8hi(mean - (v8hi)local_mean);
+		for (int i = 0; i < 8; i++)
+			response[x + i] = final[i];
+		max_response = final > max_response ? final : max_response;
+	}
+
+	int16_t max_tail = row_kernel_scalar(row, response, x, x1);
+	for (int i = 0; i < 8; i++)
+		max_tail = std::max(max_tail, (int16_t)max_response[i]);
+	return max_tail;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CORNER_DETECT_X86 1
+#include <immintrin.h>
+
+__attribute__ ((target("sse4.1")))
+static inline __m128i load_epi16_sse41(const uint8_t *p)
+{
+	return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)p));
+}
+
+/**
+ * Summation and differencing for one group of ring samples a quarter turn
+ * apart, accumulated into the running responses
+ */
+__attribute__ ((target("sse4.1")))
+static inline void sd_sse41(__m128i a, __m128i b, __m128i c, __m128i d,
+		__m128i *sum_response, __m128i *diff_response, __m128i *mean)
+{
+	*sum_response = _mm_add_epi16(*sum_response,
+		_mm_abs_epi16(_mm_sub_epi16(_mm_add_epi16(a, c), _mm_add_epi16(b, d))));
+	*diff_response = _mm_add_epi16(*diff_response,
+		_mm_add_epi16(_mm_abs_epi16(_mm_sub_epi16(a, c)), _mm_abs_epi16(_mm_sub_epi16(b, d))));
+	*mean = _mm_add_epi16(*mean, _mm_add_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, d)));
+}
+
+/**
+ * Largest of the eight lanes
+ */
+__attribute__ ((target("sse4.1")))
+static inline int16_t hmax_epi16_sse41(__m128i v)
+{
+	v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_max_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (int16_t)_mm_extract_epi16(v, 0);
+}
+
+/**
+ * SSE4.1 variant, 8 response pixels per iteration
+ */
+__attribute__ ((target("sse4.1")))
+static int16_t row_kernel_sse41(const uint8_t *const row[11], int16_t response[], size_t x0, size_t x1)
+{
+	const __m128i div3 = _mm_set1_epi16(LOCAL_MEAN_DIV3_MAGIC);
+	__m128i max_response = _mm_setzero_si128();
+	size_t x = x0;
+	for (; x + 8 <= x1; x += 8) {
+		__m128i sum_response = _mm_setzero_si128();
+		__m128i diff_response = sum_response, mean = sum_response;
+
+		sd_sse41(load_epi16_sse41(&row[0][x + 2]), load_epi16_sse41(&row[3][x - 5]),
+			load_epi16_sse41(&row[10][x - 2]), load_epi16_sse41(&row[7][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_sse41(load_epi16_sse41(&row[0][x]), load_epi16_sse41(&row[5][x - 5]),
+			load_epi16_sse41(&row[10][x]), load_epi16_sse41(&row[5][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_sse41(load_epi16_sse41(&row[0][x - 2]), load_epi16_sse41(&row[7][x - 5]),
+			load_epi16_sse41(&row[10][x + 2]), load_epi16_sse41(&row[3][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_sse41(load_epi16_sse41(&row[1][x - 4]), load_epi16_sse41(&row[9][x - 4]),
+			load_epi16_sse41(&row[9][x + 4]), load_epi16_sse41(&row[1][x + 4]),
+			&sum_response, &diff_response, &mean);
+
+		// purely horizontal local_mean samples
+		__m128i local_mean = _mm_add_epi16(_mm_add_epi16(load_epi16_sse41(&row[5][x - 1]),
+			load_epi16_sse41(&row[5][x])), load_epi16_sse41(&row[5][x + 1]));
+		local_mean = _mm_mulhi_epu16(_mm_slli_epi16(local_mean, 4), div3);
+
+		// reject stripe case by removing difference in means
+		__m128i final = _mm_sub_epi16(_mm_sub_epi16(sum_response, diff_response),
+			_mm_abs_epi16(_mm_sub_epi16(mean, local_mean)));
+		_mm_storeu_si128((__m128i *)&response[x], final);
+		max_response = _mm_max_epi16(max_response, final);
+	}
+
+	return std::max(row_kernel_scalar(row, response, x, x1), hmax_epi16_sse41(max_response));
+}
+
+__attribute__ ((target("avx2")))
+static inline __m256i load_epi16_avx2(const uint8_t *p)
+{
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+/**
+ * Summation and differencing for one group of ring samples a quarter turn
+ * apart, accumulated into the running responses
+ */
+__attribute__ ((target("avx2")))
+static inline void sd_avx2(__m256i a, __m256i b, __m256i c, __m256i d,
+		__m256i *sum_response, __m256i *diff_response, __m256i *mean)
+{
+	*sum_response = _mm256_add_epi16(*sum_response,
+		_mm256_abs_epi16(_mm256_sub_epi16(_mm256_add_epi16(a, c), _mm256_add_epi16(b, d))));
+	*diff_response = _mm256_add_epi16(*diff_response,
+		_mm256_add_epi16(_mm256_abs_epi16(_mm256_sub_epi16(a, c)), _mm256_abs_epi16(_mm256_sub_epi16(b, d))));
+	*mean = _mm256_add_epi16(*mean, _mm256_add_epi16(_mm256_add_epi16(a, b), _mm256_add_epi16(c, d)));
+}
+
+/**
+ * AVX2 variant, 16 response pixels per iteration
+ */
+__attribute__ ((target("avx2")))
+static int16_t row_kernel_avx2(const uint8_t *const row[11], int16_t response[], size_t x0, size_t x1)
+{
+	const __m256i div3 = _mm256_set1_epi16(LOCAL_MEAN_DIV3_MAGIC);
+	__m256i max_response = _mm256_setzero_si256();
+	size_t x = x0;
+	for (; x + 16 <= x1; x += 16) {
+		__m256i sum_response = _mm256_setzero_si256();
+		__m256i diff_response = sum_response, mean = sum_response;
+
+		sd_avx2(load_epi16_avx2(&row[0][x + 2]), load_epi16_avx2(&row[3][x - 5]),
+			load_epi16_avx2(&row[10][x - 2]), load_epi16_avx2(&row[7][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_avx2(load_epi16_avx2(&row[0][x]), load_epi16_avx2(&row[5][x - 5]),
+			load_epi16_avx2(&row[10][x]), load_epi16_avx2(&row[5][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_avx2(load_epi16_avx2(&row[0][x - 2]), load_epi16_avx2(&row[7][x - 5]),
+			load_epi16_avx2(&row[10][x + 2]), load_epi16_avx2(&row[3][x + 5]),
+			&sum_response, &diff_response, &mean);
+		sd_avx2(load_epi16_avx2(&row[1][x - 4]), load_epi16_avx2(&row[9][x - 4]),
+			load_epi16_avx2(&row[9][x + 4]), load_epi16_avx2(&row[1][x + 4]),
+			&sum_response, &diff_response, &mean);
+
+		// purely horizontal local_mean samples
+		__m256i local_mean = _mm256_add_epi16(_mm256_add_epi16(load_epi16_avx2(&row[5][x - 1]),
+			load_epi16_avx2(&row[5][x])), load_epi16_avx2(&row[5][x + 1]));
+		local_mean = _mm256_mulhi_epu16(_mm256_slli_epi16(local_mean, 4), div3);
+
+		// reject stripe case by removing difference in means
+		__m256i final = _mm256_sub_epi16(_mm256_sub_epi16(sum_response, diff_response),
+			_mm256_abs_epi16(_mm256_sub_epi16(mean, local_mean)));
+		_mm256_storeu_si256((__m256i *)&response[x], final);
+		max_response = _mm256_max_epi16(max_response, final);
+	}
+
+	return std::max(row_kernel_scalar(row, response, x, x1),
+		hmax_epi16_sse41(_mm_max_epi16(_mm256_castsi256_si128(max_response),
+			_mm256_extracti128_si256(max_response, 1))));
+}
+#endif	/* x86 */
+#endif	/* __GNUC__ */
+
+/**
+ * Looks up the row kernel for a given implementation
+ *
+ * @param	impl	requested implementation
+ * @return		the kernel, or NULL if not available on this build/CPU
+ */
+static row_kernel_fn row_kernel_for(enum corner_detect_impl impl)
+{
+	switch (impl) {
+	case CORNER_DETECT_SCALAR:
+		return row_kernel_scalar;
+#if defined(__GNUC__)
+	case CORNER_DETECT_VECTOR:
+		return row_kernel_vector;
+#endif
+#if defined(CORNER_DETECT_X86)
+	case CORNER_DETECT_SSE41:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.1") ? row_kernel_sse41 : NULL;
+	case CORNER_DETECT_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? row_kernel_avx2 : NULL;
+#endif
+	case CORNER_DETECT_AUTO:
+		return row_kernel_for(corner_detect_best_impl());
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Picks the fastest implementation the running CPU supports
+ *
+ * @return		the implementation corner_detect5() dispatches to
+ */
+enum corner_detect_impl corner_detect_best_impl(void)
+{
+	static const enum corner_detect_impl best =
+		row_kernel_for(CORNER_DETECT_AVX2) ? CORNER_DETECT_AVX2 :
+		row_kernel_for(CORNER_DETECT_SSE41) ? CORNER_DETECT_SSE41 :
+		row_kernel_for(CORNER_DETECT_VECTOR) ? CORNER_DETECT_VECTOR :
+		CORNER_DETECT_SCALAR;
+
+	return best;
+}
+
+#define GATE_BLOCK 16	// pixels per contrast gate decision
+
+/**
+ * Cheap contrast test for the pixels [x0, x1) of a row: the range of the
+ * four axis aligned and of the four diagonal ring samples.  At a corner one
+ * of the two crosses straddles dark and light quadrants whatever the
+ * orientation, while on smooth areas both ranges stay small.  Runs 16
+ * pixels at a time with SSE2
+ *
+ * @param	row	the eleven image rows the sampling ring touches
+ * @param	x0	first pixel to test
+ * @param	x1	one past the last pixel to test
+ * @param	gate	minimum contrast (grey levels), at least 1
+ * @return		true if any pixel reaches the minimum contrast
+ */
+static bool gate_passes(const uint8_t *const row[11], size_t x0, size_t x1, int gate)
+{
+	const uint8_t *n = row[0], *s = row[10], *we = row[5], *nd = row[1], *sd = row[9];
+	size_t x = x0;
+
+#if defined(__SSE2__)
+	// range >= gate  <=>  range saturating-minus (gate - 1) is not zero
+	const __m128i bias = _mm_set1_epi8((char)(std::min(gate, 256) - 1));
+	__m128i pass = _mm_setzero_si128();
+	for (; x + 16 <= x1; x += 16) {
+		const __m128i an = _mm_loadu_si128((const __m128i *)&n[x]);
+		const __m128i as = _mm_loadu_si128((const __m128i *)&s[x]);
+		const __m128i aw = _mm_loadu_si128((const __m128i *)&we[x - 5]);
+		const __m128i ae = _mm_loadu_si128((const __m128i *)&we[x + 5]);
+		const __m128i dnw = _mm_loadu_si128((const __m128i *)&nd[x - 4]);
+		const __m128i dne = _mm_loadu_si128((const __m128i *)&nd[x + 4]);
+		const __m128i dsw = _mm_loadu_si128((const __m128i *)&sd[x - 4]);
+		const __m128i dse = _mm_loadu_si128((const __m128i *)&sd[x + 4]);
+		const __m128i axis = _mm_subs_epu8(
+			_mm_max_epu8(_mm_max_epu8(an, as), _mm_max_epu8(aw, ae)),
+			_mm_min_epu8(_mm_min_epu8(an, as), _mm_min_epu8(aw, ae)));
+		const __m128i diag = _mm_subs_epu8(
+			_mm_max_epu8(_mm_max_epu8(dnw, dne), _mm_max_epu8(dsw, dse)),
+			_mm_min_epu8(_mm_min_epu8(dnw, dne), _mm_min_epu8(dsw, dse)));
+		pass = _mm_or_si128(pass, _mm_subs_epu8(_mm_max_epu8(axis, diag), bias));
+	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(pass, _mm_setzero_si128())) != 0xffff)
+		return true;
+#endif
+	for (; x < x1; x++) {
+		const int an = n[x], as = s[x], aw = we[x - 5], ae = we[x + 5];
+		const int dnw = nd[x - 4], dne = nd[x + 4], dsw = sd[x - 4], dse = sd[x + 4];
+		const int axis = std::max(std::max(an, as), std::max(aw, ae)) -
+				 std::min(std::min(an, as), std::min(aw, ae));
+		const int diag = std::max(std::max(dnw, dne), std::max(dsw, dse)) -
+				 std::min(std::min(dnw, dne), std::min(dsw, dse));
+		if (std::max(axis, diag) >= gate)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Writes one response row: zero outside the pixels the sampling ring fits in,
+ * the kernel's output inside.  The response buffer therefore never needs
+ * clearing beforehand.  With a contrast gate, blocks of GATE_BLOCK pixels
+ * failing gate_passes() are set to zero instead of being computed
+ *
+ * @param	kernel	row kernel
+ * @param	row	the eleven image rows centred on this one, or NULL for a
+ *			row the ring does not fit in
+ * @param	w	image width
+ * @param	response	output response row
+ * @param	gate	minimum ring contrast, 0 to compute every pixel
+ * @param	skipped	incremented by the number of gated out pixels
+ * @return		the largest response written, or 0
+ */
+static int16_t response_row(row_kernel_fn kernel, const uint8_t *const row[11],
+			    const size_t w, int16_t response[], int gate, size_t *skipped)
+{
+	if (!row || w <= 14) {
+		std::fill(response, response + w, 0);
+		return 0;
+	}
+
+	std::fill(response, response + 7, 0);
+	std::fill(response + w - 7, response + w, 0);
+	if (gate <= 0)
+		return kernel(row, response, 7, w - 7);
+
+	// consecutive passing blocks are computed in one kernel call
+	int16_t max_response = 0;
+	size_t run = 0;
+	bool in_run = false;
+	for (size_t x = 7; x < w - 7; x += GATE_BLOCK) {
+		const size_t x_end = std::min(x + GATE_BLOCK, w - 7);
+		if (gate_passes(row, x, x_end, gate)) {
+			if (!in_run)
+				run = x;
+			in_run = true;
+			continue;
+		}
+		if (in_run)
+			max_response = std::max(max_response, kernel(row, response, run, x));
+		in_run = false;
+		std::fill(response + x, response + x_end, 0);
+		*skipped += x_end - x;
+	}
+	if (in_run)
+		max_response = std::max(max_response, kernel(row, response, run, w - 7));
+
+	return max_response;
+}
+
+/**
+ * Runs a row kernel over rows [y_begin, y_end) of the image.  Rows and
+ * pixels the sampling ring does not fit in are set to zero
+ *
+ * @param	kernel	row kernel
+ * @param	w	image width
+ * @param	h	image height
+ * @param	image	input image
+ * @param	image_stride	input image row stride (bytes)
+ * @param	response	output response image
+ * @param	response_stride	output response row stride (elements)
+ * @param	y_begin	first row to compute
+ * @param	y_end	one past the last row to compute
+ * @param	gate	minimum ring contrast, 0 to compute every pixel
+ * @param	skipped	if not NULL, number of pixels gated out
+ * @return		the largest response in the rows, or 0
+ */
+static int16_t detect_rows(row_kernel_fn kernel, const size_t w, const size_t h,
+			   const uint8_t image[], size_t image_stride,
+			   int16_t response[], size_t response_stride, size_t y_begin, size_t y_end,
+			   int gate, size_t *skipped)
+{
+	int16_t max_response = 0;
+	size_t gated = 0;
+
+	// funny bounds due to sampling ring radius (5) and border of previously applied blur (2)
+	for (size_t y = y_begin; y < std::min(y_end, h); y++) {
+		const uint8_t *row[11];
+		const bool inside = h > 14 && y >= 7 && y < h - 7;
+		for (int r = 0; inside && r < 11; r++)
+			row[r] = &image[(y + r - 5) * image_stride];
+
+		max_response = std::max(max_response,
+			response_row(kernel, inside ? row : NULL, w, &response[y * response_stride], gate, &gated));
+	}
+
+	if (skipped)
+		*skipped = gated;
+
+	return max_response;
+}
+
 /**
  * Perform the ChESS corner detection algorithm with a 5 px sampling radius
+ * using a specific implementation
+ *
+ * @param	impl	implementation to use
+ * @param	w	image width
+ * @param	h	image height
+ * @param	image	input image
+ * @param	response	output response image
+ * @return		false if impl is not available on this build/CPU
+ */
+bool corner_detect5_impl(enum corner_detect_impl impl, const size_t w, const size_t h,
+			 const uint8_t image[], int16_t response[])
+{
+	row_kernel_fn kernel = row_kernel_for(impl);
+	if (!kernel)
+		return false;
+
+	detect_rows(kernel, w, h, image, w, response, w, 0, h, 0, NULL);
+
+	return true;
+}
+
+/**
+ * Perform the ChESS corner detection algorithm with a 5 px sampling radius
+ * on a horizontal band of the image only.  Rows are independent, so bands
+ * may be computed concurrently; the ring reads 5 rows either side of the band
+ *
+ * @param	w	image width
+ * @param	h	image height
+ * @param	image	input image
+ * @param	image_stride	input image row stride (bytes)
+ * @param	response	output response image
+ * @param	response_stride	output response row stride (elements)
+ * @param	y_begin	first row to compute
+ * @param	y_end	one past the last row to compute
+ * @param	gate	minimum ring contrast (grey levels) for a block of
+ *			pixels to be computed, 0 to compute every pixel.  Gated
+ *			out pixels are set to zero
+ * @param	skipped	if not NULL, number of pixels gated out
+ * @return		the largest response in the band, or 0
+ */
+int16_t corner_detect5_rows(const size_t w, const size_t h,
+			    const uint8_t image[], size_t image_stride,
+			    int16_t response[], size_t response_stride,
+			    size_t y_begin, size_t y_end, int gate, size_t *skipped)
+{
+	return detect_rows(row_kernel_for(CORNER_DETECT_AUTO), w, h, image, image_stride,
+			   response, response_stride, y_begin, y_end, gate, skipped);
+}
+
+/**
+ * Perform the ChESS corner detection algorithm with a 5 px sampling radius,
+ * dispatched at runtime to the fastest supported implementation
  *
  * @param	w	image width
  * @param	h	image height
@@ -266,49 +817,386 @@
  */
 void corner_detect5(const size_t w, const size_t h, const uint8_t image[], int16_t response[])
 {
-    int x, y;
-    // funny bounds due to sampling ring radius (5) and border of previously applied blur (2)
-    for (y = 7; y < h - 7; y++)
-        for (x = 7; x < w - 7; x++) {
-            const unsigned offset = x + y * w;
-            uint8_t circular_sample[16];
-
-            circular_sample[2] = image[offset - 2 - 5 * w];
-            circular_sample[1] = image[offset - 5 * w];
-            circular_sample[0] = image[offset + 2 - 5 * w];
-            circular_sample[8] = image[offset - 2 + 5 * w];
-            circular_sample[9] = image[offset + 5 * w];
-            circular_sample[10] = image[offset + 2 + 5 * w];
-            circular_sample[3] = image[offset - 4 - 4 * w];
-            circular_sample[15] = image[offset + 4 - 4 * w];
-            circular_sample[7] = image[offset - 4 + 4 * w];
-            circular_sample[11] = image[offset + 4 + 4 * w];
-            circular_sample[4] = image[offset - 5 - 2 * w];
-            circular_sample[14] = image[offset + 5 - 2 * w];
-            circular_sample[6] = image[offset - 5 + 2 * w];
-            circular_sample[12] = image[offset + 5 + 2 * w];
-            circular_sample[5] = image[offset - 5];
-            circular_sample[13] = image[offset + 5];
-
-            // purely horizontal local_mean samples
-            uint16_t local_mean = (image[offset - 1] + image[offset] + image[offset + 1]) * 16 / 3;
-
-            uint16_t sum_response = 0;
-            uint16_t diff_response = 0;
-            uint16_t mean = 0;
-
-            int sub_idx;
-            for (sub_idx = 0; sub_idx < 4; ++sub_idx) {
-                uint8_t a = circular_sample[sub_idx];
-                uint8_t b = circular_sample[sub_idx + 4];
-                uint8_t c = circular_sample[sub_idx + 8];
-                uint8_t d = circular_sample[sub_idx + 12];
-
-                sum_response += abs(a - b + c - d);
-                diff_response += abs(a - c) + abs(b - d);
-                mean += a + b + c + d;
-            }
-
-            response[offset] = sum_response - diff_response - abs(mean - local_mean);
-        }
+	corner_detect5_impl(CORNER_DETECT_AUTO, w, h, image, response);
+}
+
+/**
+ * Scalar reference implementation of corner_detect5()
+ *
+ * @param	w	image width
+ * @param	h	image height
+ * @param	image	input image
+ * @param	response	output response image
+ */
+void corner_detect5_ref(const size_t w, const size_t h, const uint8_t image[], int16_t response[])
+{
+	corner_detect5_impl(CORNER_DETECT_SCALAR, w, h, image, response);
+}
+
+/**
+ * Divides a 5x5 box sum by 25 the way cv::blur() does for 8-bit images
+ * (fixed-point multiply instead of a rounded floating point division), so the
+ * fused kernel sees exactly the pixels of a cv::blur()'ed image
+ *
+ * @param	sum	sum of 25 pixels
+ * @return		the box filtered pixel
+ */
+static inline uint8_t box5_div(unsigned sum)
+{
+	return (uint8_t)(((sum + 13) * 2621) >> 16);
+}
+
+/**
+ * Slides a set of 5-row column sums down by one row
+ *
+ * @param	w	image width
+ * @param	col_sum	per-column sums, updated in place
+ * @param	add	row entering the window
+ * @param	sub	row leaving the window
+ */
+static void box5_slide(const size_t w, uint16_t col_sum[], const uint8_t add[], const uint8_t sub[])
+{
+	size_t x = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 16 <= w; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&add[x]);
+		__m128i s = _mm_loadu_si128((const __m128i *)&sub[x]);
+		__m128i lo = _mm_loadu_si128((const __m128i *)&col_sum[x]);
+		__m128i hi = _mm_loadu_si128((const __m128i *)&col_sum[x + 8]);
+		lo = _mm_sub_epi16(_mm_add_epi16(lo, _mm_unpacklo_epi8(a, zero)), _mm_unpacklo_epi8(s, zero));
+		hi = _mm_sub_epi16(_mm_add_epi16(hi, _mm_unpackhi_epi8(a, zero)), _mm_unpackhi_epi8(s, zero));
+		_mm_storeu_si128((__m128i *)&col_sum[x], lo);
+		_mm_storeu_si128((__m128i *)&col_sum[x + 8], hi);
+	}
+#endif
+	for (; x < w; x++)
+		col_sum[x] += add[x] - sub[x];
+}
+
+/**
+ * Box blurs one image row from a set of 5-row column sums.  Pixels closer than
+ * 2 to either end are not needed by the ring and are set to zero
+ *
+ * @param	w	image width
+ * @param	col_sum	per-column sum of the five rows centred on this row
+ * @param	out	output blurred row
+ */
+static void box5_row(const size_t w, const uint16_t col_sum[], uint8_t out[])
+{
+	size_t x = 2;
+
+	out[0] = out[1] = out[w - 2] = out[w - 1] = 0;
+#if defined(__SSE2__)
+	// sums are at most 25 * 255, so box5_div() is a 16 bit multiply-high
+	const __m128i delta = _mm_set1_epi16(13);
+	const __m128i scale = _mm_set1_epi16(2621);
+	for (; x + 8 <= w - 2; x += 8) {
+		__m128i sum = _mm_add_epi16(
+			_mm_add_epi16(_mm_loadu_si128((const __m128i *)&col_sum[x - 2]),
+				_mm_loadu_si128((const __m128i *)&col_sum[x - 1])),
+			_mm_add_epi16(_mm_loadu_si128((const __m128i *)&col_sum[x]),
+				_mm_loadu_si128((const __m128i *)&col_sum[x + 1])));
+		sum = _mm_add_epi16(sum, _mm_loadu_si128((const __m128i *)&col_sum[x + 2]));
+		__m128i v = _mm_mulhi_epu16(_mm_add_epi16(sum, delta), scale);
+		_mm_storel_epi64((__m128i *)&out[x], _mm_packus_epi16(v, v));
+	}
+#endif
+	for (; x < w - 2; x++)
+		out[x] = box5_div(col_sum[x - 2] + col_sum[x - 1] + col_sum[x] + col_sum[x + 1] + col_sum[x + 2]);
+}
+
+/**
+ * Offset of the column sums in the fused kernel's scratch space, after the
+ * eleven line buffers
+ */
+static inline size_t box5_col_sum_offset(const size_t w)
+{
+	return (11 * w + 15) & ~(size_t)15;
+}
+
+/**
+ * Scratch space needed by corner_detect5_blur_rows()
+ *
+ * @param	w	image width
+ * @return		size in bytes
+ */
+size_t corner_detect5_blur_scratch_size(const size_t w)
+{
+	return box5_col_sum_offset(w) + w * sizeof(uint16_t);
+}
+
+/**
+ * Perform the ChESS corner detection algorithm with a 5 px sampling radius on
+ * a 5x5 box blurred copy of the image, without materializing the copy.
+ * Blurred rows are produced into a ring of eleven line buffers just ahead of
+ * the response row that needs them, so the working set stays a few image rows.
+ * The response is identical to cv::blur() followed by corner_detect5(): the
+ * ring never reaches the two blurred pixels next to the image edge, so border
+ * extrapolation of the blur never comes into play.  Like corner_detect5_rows(),
+ * every pixel of the band is written
+ *
+ * @param	w	image width
+ * @param	h	image height
+ * @param	image	input (unblurred) image
+ * @param	image_stride	input image row stride (bytes)
+ * @param	response	output response image
+ * @param	response_stride	output response row stride (elements)
+ * @param	y_begin	first row to compute
+ * @param	y_end	one past the last row to compute
+ * @param	scratch	corner_detect5_blur_scratch_size(w) bytes of line buffer
+ *			space, one per concurrent call; NULL to allocate
+ * @param	gate	minimum ring contrast, as corner_detect5_rows()
+ * @param	skipped	if not NULL, number of pixels gated out
+ * @return		the largest response in the band, or 0
+ */
+int16_t corner_detect5_blur_rows(const size_t w, const size_t h,
+				 const uint8_t image[], size_t image_stride,
+				 int16_t response[], size_t response_stride,
+				 size_t y_begin, size_t y_end, uint8_t scratch[], int gate, size_t *skipped)
+{
+	y_end = std::min(y_end, h);
+	const bool fits = w > 14 && h > 14;
+	const size_t y0 = fits ? std::min(std::max(y_begin, (size_t)7), h - 7) : y_end;
+	const size_t y1 = fits ? std::max(std::min(y_end, h - 7), y0) : y_end;
+	int16_t max_response = 0;
+	size_t gated = 0;
+
+	if (skipped)
+		*skipped = 0;
+
+	// rows the sampling ring does not fit in
+	for (size_t y = y_begin; y < y_end; y++)
+		if (y < y0 || y >= y1)
+			response_row(NULL, NULL, w, &response[y * response_stride], 0, NULL);
+
+	if (y0 >= y1)
+		return 0;
+
+	row_kernel_fn kernel = row_kernel_for(CORNER_DETECT_AUTO);
+	std::vector<uint8_t> own_scratch;
+	if (!scratch) {
+		own_scratch.resize(corner_detect5_blur_scratch_size(w));
+		scratch = &own_scratch[0];
+	}
+	uint8_t *ring = scratch;
+	uint16_t *col_sum = (uint16_t *)(scratch + box5_col_sum_offset(w));
+	std::fill(col_sum, col_sum + w, 0);
+
+	// blurred rows y0 - 5 .. y1 + 4 are needed; seed the column sums with
+	// the five source rows around the first of them
+	for (size_t r = y0 - 7; r <= y0 - 3; r++)
+		for (size_t x = 0; x < w; x++)
+			col_sum[x] += image[r * image_stride + x];
+
+	for (size_t r = y0 - 5; r < y1 + 5; r++) {
+		if (r > y0 - 5)
+			box5_slide(w, col_sum, &image[(r + 2) * image_stride], &image[(r - 3) * image_stride]);
+		box5_row(w, col_sum, &ring[(r % 11) * w]);
+
+		if (r >= y0 + 5) {
+			const size_t y = r - 5;
+			const uint8_t *row[11];
+			for (int k = 0; k < 11; k++)
+				row[k] = &ring[((y + k - 5) % 11) * w];
+
+			max_response = std::max(max_response,
+				response_row(kernel, row, w, &response[y * response_stride], gate, &gated));
+		}
+	}
+
+	if (skipped)
+		*skipped = gated;
+
+	return max_response;
+}
+
+/**
+ * Box blurs a square patch of the image like cv::blur() (5x5, reflected
+ * borders), for callers of corner_detect5_blur_rows() that need blurred
+ * pixels around a few points only
+ *
+ * @param	w	image width
+ * @param	h	image height
+ * @param	image	input (unblurred) image
+ * @param	image_stride	input image row stride (bytes)
+ * @param	cx	patch centre column
+ * @param	cy	patch centre row
+ * @param	radius	patch radius; the patch is (2 * radius + 1) pixels wide
+ * @param	patch	output patch, row-major
+ */
+void box_blur5_patch(const size_t w, const size_t h, const uint8_t image[], size_t image_stride,
+		     int cx, int cy, int radius, uint8_t patch[])
+{
+	const int side = 2 * radius + 1;
+
+	for (int py = 0; py < side; py++)
+		for (int px = 0; px < side; px++) {
+			unsigned sum = 0;
+			for (int dy = -2; dy <= 2; dy++) {
+				// BORDER_REFLECT_101, as cv::blur() uses by default
+				int y = cy - radius + py + dy;
+				y = y < 0 ? -y : y >= (int)h ? 2 * ((int)h - 1) - y : y;
+				for (int dx = -2; dx <= 2; dx++) {
+					int x = cx - radius + px + dx;
+					x = x < 0 ? -x : x >= (int)w ? 2 * ((int)w - 1) - x : x;
+					sum += image[y * image_stride + x];
+				}
+			}
+			patch[py * side + px] = box5_div(sum);
+		}
+}
+
+/*
+ * Radius 10 sampling ring.  The ring is the radius 5 one scaled by two, so
+ * for the pixels of one column parity it only touches every other column
+ * and row: on column-deinterleaved rows it is the radius 5 ring, and the
+ * radius 5 row kernels (and contrast gate) are reused as they are.  The
+ * local mean then spans x - 2 .. x + 2.  Pixels closer than 14 to the image
+ * edge (the radius 5 border, doubled) are set to zero
+ */
+
+/**
+ * Splits an image row into its even and odd columns
+ *
+ * @param	w	image width
+ * @param	src	image row
+ * @param	even	output, (w + 1) / 2 pixels
+ * @param	odd	output, w / 2 pixels
+ */
+static void deinterleave_row(const size_t w, const uint8_t src[], uint8_t even[], uint8_t odd[])
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i low = _mm_set1_epi16(0x00ff);
+	for (; 2 * i + 32 <= w; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&src[2 * i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[2 * i + 16]);
+		_mm_storeu_si128((__m128i *)&even[i],
+			_mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+		_mm_storeu_si128((__m128i *)&odd[i],
+			_mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+	}
+#endif
+	for (; 2 * i + 1 < w; i++) {
+		even[i] = src[2 * i];
+		odd[i] = src[2 * i + 1];
+	}
+	if (2 * i < w)
+		even[i] = src[2 * i];
+}
+
+/**
+ * Offset of the response rows in the radius 10 kernel's scratch space,
+ * after the 21 deinterleaved line buffers
+ */
+static inline size_t ring10_resp_offset(const size_t w)
+{
+	return (21 * w + 15) & ~(size_t)15;
+}
+
+/**
+ * Scratch space needed by corner_detect10_rows()
+ *
+ * @param	w	image width
+ * @return		size in bytes
+ */
+size_t corner_detect10_scratch_size(const size_t w)
+{
+	return ring10_resp_offset(w) + ((w + 1) / 2 + w / 2) * sizeof(int16_t);
+}
+
+/**
+ * Perform the ChESS corner detection algorithm with a 10 px sampling radius
+ * on a horizontal band of the image, for large features (close-ups).  The
+ * rows the ring needs are deinterleaved into a ring of line buffers as the
+ * band is walked down, and every pixel of the band is written
+ *
+ * @param	w	image width
+ * @param	h	image height
+ * @param	image	input image
+ * @param	image_stride	input image row stride (bytes)
+ * @param	response	output response image
+ * @param	response_stride	output response row stride (elements)
+ * @param	y_begin	first row to compute
+ * @param	y_end	one past the last row to compute
+ * @param	scratch	corner_detect10_scratch_size(w) bytes of line buffer
+ *			space, one per concurrent call; NULL to allocate
+ * @param	gate	minimum ring contrast, as corner_detect5_rows()
+ * @param	skipped	if not NULL, number of pixels gated out
+ * @return		the largest response in the band, or 0
+ */
+int16_t corner_detect10_rows(const size_t w, const size_t h,
+			     const uint8_t image[], size_t image_stride,
+			     int16_t response[], size_t response_stride,
+			     size_t y_begin, size_t y_end, uint8_t scratch[], int gate, size_t *skipped)
+{
+	y_end = std::min(y_end, h);
+	const bool fits = w > 28 && h > 28;
+	const size_t y0 = fits ? std::min(std::max(y_begin, (size_t)14), h - 14) : y_end;
+	const size_t y1 = fits ? std::max(std::min(y_end, h - 14), y0) : y_end;
+	int16_t max_response = 0;
+	size_t gated = 0;
+
+	if (skipped)
+		*skipped = 0;
+
+	// rows the sampling ring does not fit in
+	for (size_t y = y_begin; y < y_end; y++)
+		if (y < y0 || y >= y1)
+			response_row(NULL, NULL, w, &response[y * response_stride], 0, NULL);
+
+	if (y0 >= y1)
+		return 0;
+
+	row_kernel_fn kernel = row_kernel_for(CORNER_DETECT_AUTO);
+	std::vector<uint8_t> own_scratch;
+	if (!scratch) {
+		own_scratch.resize(corner_detect10_scratch_size(w));
+		scratch = &own_scratch[0];
+	}
+	// each line buffer holds the even columns, then the odd ones
+	const size_t half_w[2] = { (w + 1) / 2, w / 2 };
+	uint8_t *ring = scratch;
+	int16_t *half_resp = (int16_t *)(scratch + ring10_resp_offset(w));
+
+	for (size_t r = y0 - 10; r < y1 + 10; r++) {
+		uint8_t *line = &ring[(r % 21) * w];
+		deinterleave_row(w, &image[r * image_stride], line, line + half_w[0]);
+
+		if (r >= y0 + 10) {
+			const size_t y = r - 10;
+			for (int p = 0; p < 2; p++) {
+				const uint8_t *row[11];
+				for (int k = 0; k < 11; k++)
+					row[k] = &ring[((y + 2 * k - 10) % 21) * w] + p * half_w[0];
+
+				max_response = std::max(max_response,
+					response_row(kernel, row, half_w[p], half_resp + p * half_w[0], gate, &gated));
+			}
+
+			int16_t *out = &response[y * response_stride];
+			for (size_t x = 0; x < w; x++)
+				out[x] = half_resp[(x & 1) * half_w[0] + x / 2];
+		}
+	}
+
+	if (skipped)
+		*skipped = gated;
+
+	return max_response;
+}
+
+/**
+ * Perform the ChESS corner detection algorithm with a 10 px sampling radius
+ *
+ * @param	w	image width
+ * @param	h	image height
+ * @param	image	input image
+ * @param	response	output response image
+ */
+void corner_detect10(const size_t w, const size_t h, const uint8_t image[], int16_t response[])
+{
+	corner_detect10_rows(w, h, image, w, response, w, 0, h, NULL, 0, NULL);
 }
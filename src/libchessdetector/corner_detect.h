@@ -6,8 +6,47 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/**
+ * Implementations of the ChESS response kernel.  All produce bit-identical
+ * output; AUTO picks the fastest one the running CPU supports
+ */
+enum corner_detect_impl {
+	CORNER_DETECT_AUTO = 0,
+	CORNER_DETECT_SCALAR,	// reference
+	CORNER_DETECT_VECTOR,	// portable compiler vector extension
+	CORNER_DETECT_SSE41,
+	CORNER_DETECT_AVX2
+};
+
 // void corner_detect5(const size_t w, const size_t h, const uint8_t image[w * h], int16_t response[w * h]);
 void corner_detect5(const size_t w, const size_t h, const uint8_t image[], int16_t response[]);
+void corner_detect5_ref(const size_t w, const size_t h, const uint8_t image[], int16_t response[]);
+// band of rows, with row strides (image in bytes, response in elements),
+// optionally skipping blocks of low ring contrast (gate > 0)
+int16_t corner_detect5_rows(const size_t w, const size_t h,
+			    const uint8_t image[], size_t image_stride,
+			    int16_t response[], size_t response_stride,
+			    size_t y_begin, size_t y_end, int gate = 0, size_t *skipped = NULL);
+// same as corner_detect5_rows(), on a 5x5 box blurred image (blur fused into the kernel)
+int16_t corner_detect5_blur_rows(const size_t w, const size_t h,
+				 const uint8_t image[], size_t image_stride,
+				 int16_t response[], size_t response_stride,
+				 size_t y_begin, size_t y_end, uint8_t scratch[],
+				 int gate = 0, size_t *skipped = NULL);
+size_t corner_detect5_blur_scratch_size(const size_t w);
+void box_blur5_patch(const size_t w, const size_t h, const uint8_t image[], size_t image_stride,
+		     int cx, int cy, int radius, uint8_t patch[]);
+bool corner_detect5_impl(enum corner_detect_impl impl, const size_t w, const size_t h,
+			 const uint8_t image[], int16_t response[]);
+enum corner_detect_impl corner_detect_best_impl(void);
 //void corner_detect10(const size_t w, const size_t h, const uint8_t image[w * h], int16_t response[w * h]);
+void corner_detect10(const size_t w, const size_t h, const uint8_t image[], int16_t response[]);
+// radius 10 ring on a band of rows; pixels closer than 14 to the edge are zero
+int16_t corner_detect10_rows(const size_t w, const size_t h,
+			     const uint8_t image[], size_t image_stride,
+			     int16_t response[], size_t response_stride,
+			     size_t y_begin, size_t y_end, uint8_t scratch[],
+			     int gate = 0, size_t *skipped = NULL);
+size_t corner_detect10_scratch_size(const size_t w);
 
 #endif /* CORNER_DETECT_H */
@@ -48,7 +48,8 @@ int assign_orientation(size_t w, uint8_t *image, off_t val_off, int r)
 	};
 
 	// uninitialized_var() is just a macro to quieten the (stupid) compiler
-	int max_response = 0, response;
+	// (0 when there is no response at all, as assign_orientations())
+	int max_response = 0, response = 0;
 	// all we basically do is find which of the four rotations has the
 	// biggest magnitude, and then determine if it's +ve or -ve
 	for (int s = 0; s < 4; s++) {
@@ -75,3 +76,73 @@ int assign_orientation(size_t w, uint8_t *image, off_t val_off, int r)
 
 	return response;
 }
+
+#define ORIENTATION_BATCH 64	// points per pass of assign_orientations()
+
+/**
+ * Batched assign_orientation(): the sampling ring values of a batch of points
+ * are gathered first, then the rotations are classified in a branch-free
+ * loop over the batch, which the compiler can vectorize
+ *
+ * @param	w	image width (row stride)
+ * @param	image	the camera image
+ * @param	val_off	the offsets of the features within the image array
+ * @param	n	number of features
+ * @param	r	the radius multiplier for the sampling ring
+ * @param	ori	the detected feature orientations, in [-4, 3]
+ * @param	hist	if not NULL, histogram of ori, bin ori + 4
+ */
+void assign_orientations(size_t w, const uint8_t *image, const off_t val_off[], int n, int r,
+			 int ori[], int hist[8])
+{
+	const off_t sw = w;
+
+	// sampling cross offsets, in the order of assign_orientation()
+	const off_t ring[4][4] = {
+		{ -r * 2 - r * 5 * sw, r * 5 - r * 2 * sw, r * 2 + r * 5 * sw, -r * 5 + r * 2 * sw },
+		{ -r * 5 * sw, r * 5, r * 5 * sw, -r * 5 },
+		{ r * 2 - r * 5 * sw, r * 5 + r * 2 * sw, -r * 2 + r * 5 * sw, -r * 5 - r * 2 * sw },
+		{ r * 4 - r * 4 * sw, r * 4 + r * 4 * sw, -r * 4 + r * 4 * sw, -r * 4 - r * 4 * sw }
+	};
+
+	if (hist)
+		for (int b = 0; b < 8; b++)
+			hist[b] = 0;
+
+	for (int i0 = 0; i0 < n; i0 += ORIENTATION_BATCH) {
+		const int m = n - i0 < ORIENTATION_BATCH ? n - i0 : ORIENTATION_BATCH;
+		int val[4][ORIENTATION_BATCH];
+
+		// gather
+		for (int s = 0; s < 4; s++)
+			for (int i = 0; i < m; i++) {
+				const uint8_t *p = image + val_off[i0 + i];
+				val[s][i] = p[ring[s][0]] - p[ring[s][1]] + p[ring[s][2]] - p[ring[s][3]];
+			}
+
+		// classify: strongest of the four averaged rotations, first one
+		// on ties, signed by its middle rotation
+		for (int i = 0; i < m; i++) {
+			const int v0 = val[0][i], v1 = val[1][i], v2 = val[2][i], v3 = val[3][i];
+			const int a0 = abs(-v3 + v0 + v1);
+			const int a1 = abs(v0 + v1 + v2);
+			const int a2 = abs(v1 + v2 + v3);
+			const int a3 = abs(v2 + v3 - v0);
+			int max_response = 0, response = 0;
+
+			response = a0 > max_response ? (v0 < 0 ? -4 : 0) : response;
+			max_response = a0 > max_response ? a0 : max_response;
+			response = a1 > max_response ? (v1 < 0 ? -3 : 1) : response;
+			max_response = a1 > max_response ? a1 : max_response;
+			response = a2 > max_response ? (v2 < 0 ? -2 : 2) : response;
+			max_response = a2 > max_response ? a2 : max_response;
+			response = a3 > max_response ? (v3 < 0 ? -1 : 3) : response;
+
+			ori[i0 + i] = response;
+		}
+	}
+
+	if (hist)
+		for (int i = 0; i < n; i++)
+			hist[ori[i] + 4]++;
+}
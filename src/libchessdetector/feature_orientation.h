@@ -34,5 +34,7 @@ static inline int orientation_diff(int ori_a, int ori_b)
 }
 
 int assign_orientation(size_t w, uint8_t *image, off_t val_off, int r);
+void assign_orientations(size_t w, const uint8_t *image, const off_t val_off[], int n, int r,
+			 int ori[], int hist[8]);
 
 #endif /* FEATURE_ORIENTATION_H */
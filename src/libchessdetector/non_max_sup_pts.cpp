@@ -26,68 +26,53 @@
 // (radius being the basic non-maximal suppression radius)
 // #define MAX_POINTS_TO_CONSIDER ((w / radius) * (h / radius))
 
-/**
- * The attribute structure for potentially significant maxima
- */
-struct consider_point {
-	bool valid;
-	struct icoord coord;
-	uint16_t max;	// the strength of the response, as given by the sum of the two most intense pixels
-	struct fcoord com;
-	int mass;	// the strength of the response, as given by the sum of connected pixels
-};
-
 #define COM_RADIUS 7	// half-width of area sampled by com() below
 
 /**
  * Centre of mass finding function, for a given response cluster
  *
- * @param	r	radius over which to include responses
- * @param	w	response image width
+ * The radius is a compile time constant so that the visited mask and the
+ * to-visit stack live on the stack: no allocation per maximum
+ *
+ * @param	R	radius over which to include responses
+ * @param	stride	response image row stride (elements)
  * @param	ri	response image
  * @param	cp	a consideration point, providing maximal point
  * 			co-ordinates, getting CoM co-ordinates in return
  */
-static void com(int r, size_t w, int16_t *ri, struct consider_point *cp)
+template <int R>
+static void com(size_t stride, const int16_t *ri, struct consider_point *cp)
 {
-	char sz = 2 * r + 1;
-// 	bool **_visited = new bool*[sz];
-// 	for(char i = 0; i < sz; ++i)
-// 		_visited[i] = new bool[sz];
+	enum { SZ = 2 * R + 1 };
 
-	bool **visited = new bool*[sz];
-	for(char i = 0; i < sz; ++i)
-		visited[i] = new bool[sz];
+	// visited[y + R][x + R], every pixel is pushed at most once
+	bool visited[SZ][SZ];
+	struct icoord to_visit[SZ * SZ];
 
-	std::vector<icoord> to_visit(sz * sz);
-	
 	int tvl = 1;
-	off_t off = cp->coord.x + cp->coord.y * w;
+	off_t off = cp->coord.x + cp->coord.y * stride;
 	int xsum = 0, ysum = 0, m = 0;
 
 	// rather than take the CoM of the whole area, this only includes
-	// above threshold responses connected in one of lrud to the maximal
-	// point
-// 	memset(_visited, 0, sizeof(_visited));
+	// above threshold responses connected (8-way) to the maximal point
 	memset(visited, 0, sizeof(visited));
-// 	visited = (bool (*)[sz])&_visited[r][r];
-	visited[0][0] = true;
+	visited[R][R] = true;
 	to_visit[0].x = 0; to_visit[0].y = 0;
 
 	while (tvl--) {
 		struct icoord o = to_visit[tvl], new_;
 
-		for (new_.y = std::max(o.y - 1, -r); new_.y <= std::min(o.y + 1, r); new_.y++)
-			for (new_.x = std::max(o.x - 1, -r); new_.x <= std::min(o.x + 1, r); new_.x++)
+		for (new_.y = std::max(o.y - 1, -R); new_.y <= std::min(o.y + 1, R); new_.y++)
+			for (new_.x = std::max(o.x - 1, -R); new_.x <= std::min(o.x + 1, R); new_.x++)
 				// threshold at 0.  hmm.  FIXME?
-				if (!visited[new_.x][new_.y] && ri[off + new_.x + new_.y * w] > 0) {
+				if (!visited[new_.y + R][new_.x + R] && ri[off + new_.x + new_.y * stride] > 0) {
 					to_visit[tvl++] = new_;
-					visited[new_.x][new_.y] = true;
+					visited[new_.y + R][new_.x + R] = true;
 				}
 
-		xsum += o.x * ri[off + o.x + o.y * w];
-		ysum += o.y * ri[off + o.x + o.y * w];
-		m += ri[off + o.x + o.y * w];
+		xsum += o.x * ri[off + o.x + o.y * stride];
+		ysum += o.y * ri[off + o.x + o.y * stride];
+		m += ri[off + o.x + o.y * stride];
 	}
 
 	cp->com.x = cp->coord.x + (float)xsum / m;
@@ -100,7 +85,7 @@ static void com(int r, size_t w, int16_t *ri, struct consider_point *cp)
  * of response cluster strength (combined intensity of two strongest pixels)
  * and co-ordinates of maximum as a potentially significant point
  *
- * @param	w	response image width
+ * @param	stride	response image row stride (elements)
  * @param	image	response image
  * @param	x	x co-ord of maximum
  * @param	y	y co-ord of maximum
@@ -110,10 +95,10 @@ static void com(int r, size_t w, int16_t *ri, struct consider_point *cp)
  * @param	num_found	current index into cp
  * @return		number of successfully processed points
  */
-static int process_maximum(size_t w, int16_t *image, int x, int y,
+static int process_maximum(size_t stride, int16_t *image, int x, int y,
 		           bool use_com, struct consider_point *cp, int max_cps, int *num_found)
 {
-	off_t val_off = x + (y * w);
+	off_t val_off = x + (y * stride);
 	uint16_t second_max = 0;
 	off_t second_max_off;
 
@@ -121,7 +106,7 @@ static int process_maximum(size_t w, int16_t *image, int x, int y,
 	// 8 pixels surrounding the maximum
 	for (off_t dy = -1; dy <= 1; ++dy)
 		for (off_t dx = -1; dx <= 1; ++dx) {
-			off_t offset = val_off + dx + (dy * w);
+			off_t offset = val_off + dx + (dy * stride);
 
 			if (image[offset] > second_max && (dx || dy)) {
 				second_max = image[offset];
@@ -143,7 +128,7 @@ static int process_maximum(size_t w, int16_t *image, int x, int y,
 	cp[*num_found].coord.x = x;
 	cp[*num_found].coord.y = y;
 	if (use_com)	// find CoM of connected response cluster
-		com(COM_RADIUS, w, image, &cp[(*num_found)++]);
+		com<COM_RADIUS>(stride, image, &cp[(*num_found)++]);
 	else
 		cp[(*num_found)++].mass = 0;
 
@@ -161,26 +146,30 @@ static int process_maximum(size_t w, int16_t *image, int x, int y,
  *
  * @param	w	response image width
  * @param	h	response image height
+ * @param	stride	response image row stride (elements)
  * @param	image	response image
  * @param	border	width of image border without valid points
  * @param	radius	non-maximal suppression radius
  * @param	thresh	threshold response intensity
  * @param	use_com	localize centre of mass of response?
+ * @param	y_begin	first row to search
+ * @param	y_end	one past the last row to search
  * @param	cp	intermediate list of found points
  * @param	max_cps	limit on number of potential points to locate
  * @return		number of located potential points
  */
-static int search(size_t w, size_t h, int16_t image[], int border,
-		  int radius, int thresh, bool use_com, struct consider_point *cp, int max_cps)
+static int search(size_t w, size_t h, size_t stride, int16_t image[], int border,
+		  int radius, int thresh, bool use_com, size_t y_begin, size_t y_end,
+		  struct consider_point *cp, int max_cps)
 {
 	int num_found = 0;
 	size_t min_xy = std::max(border, radius), max_x = w - std::max(border, radius), max_y = h - std::max(border, radius);
 
 	// limits to avoid reading off the response image edge
-	for (size_t y = min_xy; y < max_y; ++y)
+	for (size_t y = std::max(min_xy, y_begin); y < std::min(max_y, y_end); ++y)
 	{
 		for (size_t x = min_xy; x < max_x; ++x) {
-			off_t val_off = x + (y * w);
+			off_t val_off = x + (y * stride);
 
 			if (image[val_off] <= thresh)
 				continue;
@@ -194,7 +183,7 @@ static int search(size_t w, size_t h, int16_t image[], int border,
 			// discount this maximum if there's a stronger maxima within a (radius x radius) square
 			for (off_t dy = -radius; dy <= radius; ++dy)
 				for (off_t dx = -radius; dx <= radius; ++dx)
-					if (image[val_off + dx + (dy * w)] > image[val_off]) {
+					if (image[val_off + dx + (dy * stride)] > image[val_off]) {
 						// skip the amount to shift the stronger point out of the
 						// window WITHOUT going past the limit of known weaker points
 						// found in the previous test
@@ -209,7 +198,7 @@ static int search(size_t w, size_t h, int16_t image[], int border,
 				continue;
 
 			// must be a local maximum
-			if (process_maximum(w, image, x, y, use_com, cp, max_cps, &num_found) < 0)
+			if (process_maximum(stride, image, x, y, use_com, cp, max_cps, &num_found) < 0)
 				return num_found;
 			// it was a maximum, no stronger points exist within the radius
 			x += radius;
@@ -234,44 +223,92 @@ next:
  * intense response strengths than their neighbours (effectively local
  * lighting/contrast compensation)
  *
+ * Points are bucketed in a grid of search_size cells, so each point only
+ * compares itself with the points of the 3x3 cells around it
+ *
  * @param	num_found	number of points under consideration
  * @param	cp		list of points to consider
  * @param	search_size	radius of comparison neighbourhood
+ * @param	ws		workspace providing the grid and local list storage
  * @return			number of points suppressed
  */
-static int cull_neighbourhood(int num_found, struct consider_point cp[], char search_size)
+static int cull_neighbourhood(int num_found, struct consider_point cp[], char search_size,
+			      struct non_max_sup_workspace *ws)
 {
 	int invalidated = 0;
 
+	if (num_found <= 0)
+		return 0;
+
+	// neighbours are less than search_size apart along both axes, so they
+	// are at most one cell away from cells of at least that size
+	int cell = std::max((int)search_size, 1);
+	int min_x = cp[0].coord.x, max_x = cp[0].coord.x;
+	int min_y = cp[0].coord.y, max_y = cp[0].coord.y;
+	for (int i = 1; i < num_found; i++) {
+		min_x = std::min(min_x, cp[i].coord.x);
+		max_x = std::max(max_x, cp[i].coord.x);
+		min_y = std::min(min_y, cp[i].coord.y);
+		max_y = std::max(max_y, cp[i].coord.y);
+	}
+	// sparse points: grow the cells so the grid stays O(num_found)
+	while ((int64_t)((max_x - min_x) / cell + 1) * ((max_y - min_y) / cell + 1) > 8 * (int64_t)num_found + 64)
+		cell *= 2;
+	const int grid_w = (max_x - min_x) / cell + 1;
+	const int grid_h = (max_y - min_y) / cell + 1;
+
+	// counting sort of the point indices by cell, ascending within a cell
+	std::vector<int> &start = ws->cell_start;
+	std::vector<int> &items = ws->cell_items;
+	start.assign(grid_w * grid_h + 1, 0);
+	if (items.size() < (size_t)num_found)
+		items.resize(num_found);
+	for (int i = 0; i < num_found; i++)
+		start[(cp[i].coord.y - min_y) / cell * grid_w + (cp[i].coord.x - min_x) / cell + 1]++;
+	for (int c = 0; c < grid_w * grid_h; c++)
+		start[c + 1] += start[c];
+	for (int i = 0; i < num_found; i++)
+		items[start[(cp[i].coord.y - min_y) / cell * grid_w + (cp[i].coord.x - min_x) / cell]++] = i;
+	// filling moved each start to the next cell's, shift them back
+	for (int c = grid_w * grid_h; c > 0; c--)
+		start[c] = start[c - 1];
+	start[0] = 0;
+
+	struct consider_point **local = &ws->local[0];
+
 	// iterate through all consider_points
 	for (int i = 0; i < num_found; i++) {
-// 		struct consider_point *local[num_found];
-		std::vector<consider_point *> local(num_found);
 		int locals = 1;
 		int max = cp[i].max, maxm = cp[i].mass;
 
 		if (!cp[i].valid)
 			continue;
 
-	   	local[0] = &cp[i];
-
-		// iterate through remaining cps
-		for (int t = i + 1; t < num_found; t++) {
-			if (!cp[t].valid)
-				continue;
-			// are they within the neighbourhood area?
-			if (abs(cp[i].coord.x - cp[t].coord.x) < search_size &&
-			    abs(cp[i].coord.y - cp[t].coord.y) < search_size) {
-				// if yes, add them to "local" list
-				local[locals++] = &cp[t];
-				// and keep track of greatest response
-				// strengths in neighbourhood
-				if (cp[t].max > max)
-					max = cp[t].max;
-				if (cp[t].mass > maxm)
-					maxm = cp[t].mass;
-			}
-		}
+		local[0] = &cp[i];
+
+		const int cx = (cp[i].coord.x - min_x) / cell;
+		const int cy = (cp[i].coord.y - min_y) / cell;
+
+		// iterate through remaining cps in the surrounding cells
+		for (int gy = std::max(cy - 1, 0); gy <= std::min(cy + 1, grid_h - 1); gy++)
+			for (int gx = std::max(cx - 1, 0); gx <= std::min(cx + 1, grid_w - 1); gx++)
+				for (int k = start[gy * grid_w + gx]; k < start[gy * grid_w + gx + 1]; k++) {
+					const int t = items[k];
+					if (t <= i || !cp[t].valid)
+						continue;
+					// are they within the neighbourhood area?
+					if (abs(cp[i].coord.x - cp[t].coord.x) < search_size &&
+					    abs(cp[i].coord.y - cp[t].coord.y) < search_size) {
+						// if yes, add them to "local" list
+						local[locals++] = &cp[t];
+						// and keep track of greatest response
+						// strengths in neighbourhood
+						if (cp[t].max > max)
+							max = cp[t].max;
+						if (cp[t].mass > maxm)
+							maxm = cp[t].mass;
+					}
+				}
 
 		// determine absolute threshold levels
 		int sig = max >> DEGRADE_SHIFT;
@@ -291,25 +328,24 @@ static int cull_neighbourhood(int num_found, struct consider_point cp[], char se
  * Find the centre of mass of a 5x5 area of response image pixels
  * Used for sub-pixel localization of accepted points
  *
- * @param	w	response image width
- * @param	h	response image height
+ * @param	stride	response image row stride (elements)
  * @param	resp	response image
  * @param	o	offset of maximal point in response image
  * @param	thresh	threshold response intensity
  * @param	outx	x distance of CoM from maxima
  * @param	outy	y distance of CoM from maxima
  */
-static void com_interp5(const size_t w, const int16_t *resp, const off_t o, const int thresh,
+static void com_interp5(const size_t stride, const int16_t *resp, const off_t o, const int thresh,
 			float *outx, float *outy)
 {
 	int x_sum = 0, y_sum = 0, mass = 0;
 
 	for (int y = -2; y <= 2; y++)
 		for (int x = -2; x <= 2; x++)
-			if (resp[o + y * w + x] > thresh) {
-				x_sum += resp[o + y * w + x] * x;
-				y_sum += resp[o + y * w + x] * y;
-				mass += resp[o + y * w + x];
+			if (resp[o + y * stride + x] > thresh) {
+				x_sum += resp[o + y * stride + x] * x;
+				y_sum += resp[o + y * stride + x] * y;
+				mass += resp[o + y * stride + x];
 			}
 
 	*outx = (float)x_sum / mass;
@@ -317,29 +353,43 @@ static void com_interp5(const size_t w, const int16_t *resp, const off_t o, cons
 }
 
 /**
- * Entry point to non-maximal suppression routines
+ * Upper bound on the number of candidate maxima recorded for an image
+ *
+ * @param	w	response image width
+ * @param	h	response image height
+ * @param	radius	non-maximal suppression radius
+ * @return		number of consider_points to allocate
+ */
+int non_max_sup_max_points(size_t w, size_t h, unsigned radius)
+{
+	return (w / radius) * (h / radius);
+}
+
+/**
+ * First stage of non-maximal suppression: searches rows [y_begin, y_end) of
+ * the response image for candidate maxima.  Rows are searched independently,
+ * so the image may be split into bands searched concurrently; concatenating
+ * the per-band candidates in row order gives the same list as one call over
+ * the whole image.  Reads up to radius + COM_RADIUS rows beyond the band
  *
  * @param	w	response image width
  * @param	h	response image height
+ * @param	stride	response image row stride (elements)
  * @param	image	response image
  * @param	border	width of image border without valid points
  * @param	radius	non-maximal suppression radius
  * @param	thresh	threshold response intensity
  * @param	use_com	localize centre of mass of response?
- * @param	cn_halfwidth	radius of comparison neighbourhood
- * @param	new_pt_output	call-back to allocate/initialize storage of
- * 				accepted points
- * @param	append_pt	call-back to store an accepted localized point
+ * @param	y_begin	first row to search
+ * @param	y_end	one past the last row to search
+ * @param	cp	storage for the candidates found
+ * @param	max_cps	capacity of cp
+ * @return		number of candidates found, -1 on error
  */
-int non_max_sup_pts(size_t w, size_t h, int16_t image[], int border,
-		    unsigned radius, int thresh, bool use_com, char cn_halfwidth,
-		    void *(*new_pt_output)(int), bool (*append_pt)(void *, struct fcoord *), void **pt_output)
-{ 
-	int num_found = 0;
-
-	int MAX_POINTS_TO_CONSIDER = ((w / radius) * (h / radius));
-	struct consider_point *cp = new consider_point[MAX_POINTS_TO_CONSIDER];
-
+int non_max_sup_search(size_t w, size_t h, size_t stride, int16_t image[], int border,
+		       unsigned radius, int thresh, bool use_com, size_t y_begin, size_t y_end,
+		       struct consider_point *cp, int max_cps)
+{
 	if ((h <= 2 * std::max(border, (int)radius)) || (w <= 2 * std::max(border, (int)radius))) {
 		fprintf(stderr, "Radius too large for input image\n");
 		return -1;
@@ -350,22 +400,64 @@ int non_max_sup_pts(size_t w, size_t h, int16_t image[], int border,
 	// +/- 2 of maxima
 	border += use_com ? COM_RADIUS : 2;
 
-	// find the candidate points
-	num_found = search(w, h, image, border, radius, thresh, use_com,
-			   cp, sizeof(cp) / sizeof(struct consider_point));
+	return search(w, h, stride, image, border, radius, thresh, use_com, y_begin, y_end, cp, max_cps);
+}
 
-	if (!num_found)
-		return num_found;
+/**
+ * Locates the strongest response within a window, at sub-pixel precision,
+ * with the same 5x5 CoM as accepted points of non_max_sup_pts().  The
+ * threshold is half the window's maximum.  Used to refine points found at
+ * a coarser scale
+ *
+ * @param	stride	response image row stride (elements)
+ * @param	image	response image
+ * @param	x0	first column of the window (at least 2 px inside the image)
+ * @param	y0	first row of the window (at least 2 px inside the image)
+ * @param	x1	one past the last column of the window
+ * @param	y1	one past the last row of the window
+ * @param	pos	the peak, pixel centres at 0.5px in
+ * @return		false if no response in the window is positive
+ */
+bool non_max_sup_peak(size_t stride, int16_t image[], int x0, int y0, int x1, int y1,
+		      struct fcoord *pos)
+{
+	int16_t max = 0;
+	int max_x = -1, max_y = -1;
+
+	for (int y = y0; y < y1; y++)
+		for (int x = x0; x < x1; x++)
+			if (image[x + y * stride] > max) {
+				max = image[x + y * stride];
+				max_x = x;
+				max_y = y;
+			}
+	if (max <= 0)
+		return false;
 
-	// prune the neighbourhood weaklings
-	int culled = cull_neighbourhood(num_found, cp, cn_halfwidth);
+	float dx, dy;
+	com_interp5(stride, image, max_x + max_y * stride, max >> 1, &dx, &dy);
+	pos->x = max_x + 0.5f + dx;
+	pos->y = max_y + 0.5f + dy;
 
-	// allocate storage for the accepted points
-	if (!(*pt_output = new_pt_output(num_found - culled))) {
-		fprintf(stderr, "Point-coord struct init failed\n");
-		return -2;
-	}
+	return true;
+}
 
+/**
+ * Stores the sub-pixel location of the candidates that survived culling
+ *
+ * @param	stride	response image row stride (elements)
+ * @param	image	response image
+ * @param	thresh	threshold response intensity
+ * @param	use_com	localize centre of mass of response?
+ * @param	cp	candidates, in row order
+ * @param	num_found	number of candidates
+ * @param	append_pt	call-back to store an accepted localized point
+ * @param	pt_output	storage of accepted points
+ */
+static void localize(size_t stride, int16_t image[], int thresh, bool use_com,
+		     struct consider_point *cp, int num_found,
+		     bool (*append_pt)(void *, struct fcoord *), void *pt_output)
+{
 	for (int idx = 0; idx < num_found; idx++) {
 		if (!cp[idx].valid)
 			continue;
@@ -376,21 +468,119 @@ int non_max_sup_pts(size_t w, size_t h, int16_t image[], int border,
 			fcoord fc;
 			fc.x = cp[idx].com.x + 0.5;
 			fc.y = cp[idx].com.y + 0.5;
-			append_pt(*pt_output, &fc);
+			append_pt(pt_output, &fc);
 		} else {
-			off_t int_centre = cp[idx].coord.x + cp[idx].coord.y * w;
+			off_t int_centre = cp[idx].coord.x + cp[idx].coord.y * stride;
 			float dx, dy;
 
 			// get sub-pixel location with 5x5 CoM patch
-			com_interp5(w, image, int_centre, thresh, &dx, &dy);
+			com_interp5(stride, image, int_centre, thresh, &dx, &dy);
 
 			// pixel centres at 0.5px in, either way
 			fcoord fc;
 			fc.x = cp[idx].coord.x + 0.5f + dx;
 			fc.y = cp[idx].coord.y + 0.5f + dy;
-			append_pt(*pt_output, &fc);
+			append_pt(pt_output, &fc);
 		}
 	}
+}
+
+/**
+ * Second stage of non-maximal suppression: culls weak candidates relative to
+ * their neighbourhood and stores the sub-pixel location of the survivors.
+ * Nothing is allocated: scratch space comes from the workspace, and the
+ * output storage must have room for num_found points
+ *
+ * @param	stride	response image row stride (elements)
+ * @param	image	response image
+ * @param	thresh	threshold response intensity
+ * @param	use_com	localize centre of mass of response?
+ * @param	cn_halfwidth	radius of comparison neighbourhood
+ * @param	cp	candidates, in row order
+ * @param	num_found	number of candidates
+ * @param	ws	workspace, reserved for at least num_found candidates
+ * @param	append_pt	call-back to store an accepted localized point
+ * @param	pt_output	storage of accepted points
+ * @return		number of accepted points
+ */
+int non_max_sup_finish(size_t stride, int16_t image[], int thresh, bool use_com, char cn_halfwidth,
+		       struct consider_point *cp, int num_found, struct non_max_sup_workspace *ws,
+		       bool (*append_pt)(void *, struct fcoord *), void *pt_output)
+{
+	if (num_found <= 0)
+		return 0;
+
+	// prune the neighbourhood weaklings
+	int culled = cull_neighbourhood(num_found, cp, cn_halfwidth, ws);
+
+	localize(stride, image, thresh, use_com, cp, num_found, append_pt, pt_output);
+
+	return num_found - culled;
+}
+
+/**
+ * Sizes a workspace for the candidates of a w x h response image, searched
+ * in a number of bands that each get a slice of ws->cp of the whole image's
+ * capacity.  Storage only ever grows, so once sized for the largest image no
+ * call allocates
+ *
+ * @param	ws	workspace
+ * @param	w	response image width
+ * @param	h	response image height
+ * @param	radius	non-maximal suppression radius
+ * @param	slices	number of candidate slices (bands)
+ * @return		capacity of each slice
+ */
+int non_max_sup_reserve(struct non_max_sup_workspace *ws, size_t w, size_t h, unsigned radius, int slices)
+{
+	size_t n = std::max(non_max_sup_max_points(w, h, radius), 1);
+
+	if (ws->cp.size() < n * slices)
+		ws->cp.resize(n * slices);
+	if (ws->local.size() < n)
+		ws->local.resize(n);
+
+	return (int)n;
+}
+
+/**
+ * Entry point to non-maximal suppression routines
+ *
+ * @param	w	response image width
+ * @param	h	response image height
+ * @param	image	response image
+ * @param	border	width of image border without valid points
+ * @param	radius	non-maximal suppression radius
+ * @param	thresh	threshold response intensity
+ * @param	use_com	localize centre of mass of response?
+ * @param	cn_halfwidth	radius of comparison neighbourhood
+ * @param	new_pt_output	call-back to allocate/initialize storage of
+ * 				accepted points
+ * @param	append_pt	call-back to store an accepted localized point
+ */
+int non_max_sup_pts(size_t w, size_t h, int16_t image[], int border,
+		    unsigned radius, int thresh, bool use_com, char cn_halfwidth,
+		    void *(*new_pt_output)(int), bool (*append_pt)(void *, struct fcoord *), void **pt_output)
+{ 
+	struct non_max_sup_workspace ws;
+	int max_cps = non_max_sup_reserve(&ws, w, h, radius, 1);
+
+	// find the candidate points
+	int num_found = non_max_sup_search(w, h, w, image, border, radius, thresh, use_com,
+					   0, h, &ws.cp[0], max_cps);
+	if (num_found <= 0)
+		return num_found;
+
+	// prune the neighbourhood weaklings
+	int culled = cull_neighbourhood(num_found, &ws.cp[0], cn_halfwidth, &ws);
+
+	// allocate storage for the accepted points
+	if (!(*pt_output = new_pt_output(num_found - culled))) {
+		fprintf(stderr, "Point-coord struct init failed\n");
+		return -2;
+	}
+
+	localize(w, image, thresh, use_com, &ws.cp[0], num_found, append_pt, *pt_output);
 
 	return num_found - culled;
 }
@@ -7,6 +7,18 @@
 
 // #include <stdbool.h>
 #include <stddef.h>
+#include <vector>
+
+/**
+ * The attribute structure for potentially significant maxima
+ */
+struct consider_point {
+	bool valid;
+	struct icoord coord;
+	uint16_t max;	// the strength of the response, as given by the sum of the two most intense pixels
+	struct fcoord com;
+	int mass;	// the strength of the response, as given by the sum of connected pixels
+};
 
 // int non_max_sup_pts(size_t w, size_t h, int16_t image[w * h], int border,
 // 		    unsigned radius, int thresh, bool use_com, char compare_halfwidth,
@@ -15,4 +27,28 @@ int non_max_sup_pts(size_t w, size_t h, int16_t image[], int border,
 					unsigned radius, int thresh, bool use_com, char compare_halfwidth,
 					void *(*new_pt_output)(int), bool (*append_pt)(void *, struct fcoord *), void **pt_output);
 
+/**
+ * Storage reused across calls of the two stage interface below, so that
+ * steady state detection does not allocate
+ */
+struct non_max_sup_workspace {
+	std::vector<struct consider_point> cp;		// candidate maxima
+	std::vector<struct consider_point *> local;	// neighbourhood scratch for culling
+	std::vector<int> cell_start;			// culling grid: first item of each cell
+	std::vector<int> cell_items;			// culling grid: point indices by cell
+};
+
+// the two stages of non_max_sup_pts(), for callers that split the search into bands
+int non_max_sup_max_points(size_t w, size_t h, unsigned radius);
+int non_max_sup_reserve(struct non_max_sup_workspace *ws, size_t w, size_t h, unsigned radius, int slices);
+int non_max_sup_search(size_t w, size_t h, size_t stride, int16_t image[], int border,
+		       unsigned radius, int thresh, bool use_com, size_t y_begin, size_t y_end,
+		       struct consider_point *cp, int max_cps);
+int non_max_sup_finish(size_t stride, int16_t image[], int thresh, bool use_com, char cn_halfwidth,
+		       struct consider_point *cp, int num_found, struct non_max_sup_workspace *ws,
+		       bool (*append_pt)(void *, struct fcoord *), void *pt_output);
+// sub-pixel peak of a window of the response, for coarse to fine refinement
+bool non_max_sup_peak(size_t stride, int16_t image[], int x0, int y0, int x1, int y1,
+		      struct fcoord *pos);
+
 #endif /* NON_MAX_SUP_PTS_H */
@@ -0,0 +1,164 @@
+#include "point_clusterer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	int64_t cellKey(int cx, int cy)
+	{
+		return ((int64_t)cx << 32) ^ (uint32_t)cy;
+	}
+
+	size_t slotOf(int64_t key, size_t mask)
+	{
+		return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	}
+}
+
+
+PointClusterer::Cluster PointClusterer::largest(const std::vector<cv::Point2f> &points, float thresh,
+	std::vector<cv::Point2f> &members)
+{
+	Cluster major;
+	major.size = 0;
+	members.clear();
+
+	const int n = (int)points.size();
+	if (n == 0)
+		return major;
+
+	// Cells are a bit smaller than thresh / sqrt(2), so that all points of
+	// a cell are linked, and linked points are at most two cells apart
+	const float cell = std::max(thresh * 0.7071f, 1e-3f);
+	const float thresh2 = thresh * thresh;
+
+	m_parent.resize(n);
+	m_size.resize(n);
+	m_next.resize(n);
+
+	size_t table_size = 16;
+	while (table_size < 2 * (size_t)n)
+		table_size *= 2;
+	const size_t mask = table_size - 1;
+	m_keys.resize(table_size);
+	m_heads.assign(table_size, -1);
+	m_cells.clear();
+
+	// Hash the points, prepending to the cell's list in reverse order
+	// keeps every list in input order
+	for (int i = n - 1; i >= 0; i--)
+	{
+		const int64_t key = cellKey((int)std::floor(points[i].x / cell), (int)std::floor(points[i].y / cell));
+		size_t s = slotOf(key, mask);
+		while (m_heads[s] >= 0 && m_keys[s] != key)
+			s = (s + 1) & mask;
+		if (m_heads[s] < 0)
+			m_cells.push_back((int)s);
+		m_keys[s] = key;
+		m_next[i] = m_heads[s];
+		m_heads[s] = i;
+		m_parent[i] = i;
+		m_size[i] = 1;
+	}
+
+	for (size_t c = 0; c < m_cells.size(); c++)
+	{
+		const int head = m_heads[m_cells[c]];
+		for (int j = m_next[head]; j >= 0; j = m_next[j])
+			unite(head, j);
+	}
+
+	// Link each cell to the following half of the 5x5 cells around it,
+	// stopping at the first close pair
+	for (size_t c = 0; c < m_cells.size(); c++)
+	{
+		const int head = m_heads[m_cells[c]];
+		const int64_t key = m_keys[m_cells[c]];
+		const int cx = (int)(key >> 32), cy = (int)(int32_t)(uint32_t)key;
+		for (int dy = 0; dy <= 2; dy++)
+			for (int dx = -2; dx <= 2; dx++)
+			{
+				if (dy == 0 && dx <= 0)
+					continue;
+				const int other = cellHead(cellKey(cx + dx, cy + dy));
+				if (other < 0 || find(head) == find(other))
+					continue;
+				for (int i = head; i >= 0; i = m_next[i])
+				{
+					int j = other;
+					for (; j >= 0; j = m_next[j])
+					{
+						const cv::Point2f d = points[i] - points[j];
+						if (d.x * d.x + d.y * d.y < thresh2)
+							break;
+					}
+					if (j >= 0)
+					{
+						unite(i, j);
+						break;
+					}
+				}
+			}
+	}
+
+	// Largest root, the first one seen on ties
+	int major_root = -1;
+	for (int i = 0; i < n; i++)
+	{
+		const int r = find(i);
+		if (major_root < 0 || m_size[r] > m_size[major_root])
+			major_root = r;
+	}
+
+	major.size = m_size[major_root];
+	members.reserve(major.size);
+	float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+	for (int i = 0; i < n; i++)
+	{
+		if (find(i) != major_root)
+			continue;
+		const cv::Point2f &p = points[i];
+		members.push_back(p);
+		x0 = std::min(x0, p.x);
+		y0 = std::min(y0, p.y);
+		x1 = std::max(x1, p.x);
+		y1 = std::max(y1, p.y);
+	}
+	major.bbox = cv::Rect2f(x0, y0, x1 - x0, y1 - y0);
+
+	return major;
+}
+
+int PointClusterer::find(int i)
+{
+	// path halving
+	while (m_parent[i] != i)
+	{
+		m_parent[i] = m_parent[m_parent[i]];
+		i = m_parent[i];
+	}
+	return i;
+}
+
+void PointClusterer::unite(int a, int b)
+{
+	a = find(a);
+	b = find(b);
+	if (a == b)
+		return;
+	// union by size
+	if (m_size[a] < m_size[b])
+		std::swap(a, b);
+	m_parent[b] = a;
+	m_size[a] += m_size[b];
+}
+
+int PointClusterer::cellHead(int64_t key) const
+{
+	const size_t mask = m_heads.size() - 1;
+	for (size_t s = slotOf(key, mask); m_heads[s] >= 0; s = (s + 1) & mask)
+		if (m_keys[s] == key)
+			return m_heads[s];
+	return -1;
+}
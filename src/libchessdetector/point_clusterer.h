@@ -0,0 +1,54 @@
+/*
+    PointClusterer class
+	Single linkage clustering of 2D points under a distance threshold
+
+	Points closer than the threshold are linked, and clusters are the
+	connected components (same partition as cv::partition with a distance
+	predicate). Points are hashed into a grid of cells small enough for
+	all points of a cell to be linked, and neighbouring cells are linked
+	with a union-find as soon as one close pair is found. Storage is kept between calls: a new threshold every frame
+	does not reallocate anything.
+*/
+#ifndef POINT_CLUSTERER_H
+#define POINT_CLUSTERER_H
+
+#include <opencv2/core.hpp>
+#include <stdint.h>
+#include <vector>
+
+
+class PointClusterer
+{
+public:
+	struct Cluster
+	{
+		int size;		// number of points
+		cv::Rect2f bbox;	// bounding box of the points (may be 0 wide/high)
+	};
+
+	// Cluster 'points', linking points less than 'thresh' apart, and return
+	// the largest cluster (the one with the first point on ties).
+	// Its points are written to 'members', in input order.
+	Cluster largest(const std::vector<cv::Point2f> &points, float thresh,
+		std::vector<cv::Point2f> &members);
+
+private:
+	int find(int i);
+	void unite(int a, int b);
+
+	// First point of the cell of key 'key', -1 if the cell is empty
+	int cellHead(int64_t key) const;
+
+	// Union-find forest
+	std::vector<int> m_parent;
+	std::vector<int> m_size;
+
+	// Grid hash: open addressing table of cell keys, each slot heading
+	// a list of the cell's points chained through m_next
+	std::vector<int64_t> m_keys;
+	std::vector<int> m_heads;
+	std::vector<int> m_next;
+	std::vector<int> m_cells;	// occupied slots
+};
+
+#endif		// POINT_CLUSTERER_H
@@ -0,0 +1,93 @@
+#include "response_pool.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+
+namespace
+{
+	// Row pitch of a response 'width' pixels wide, in bytes
+	size_t rowBytes(int width, size_t alignment)
+	{
+		return cv::alignSize(width * sizeof(int16_t), (int)alignment);
+	}
+
+	// Storage needed, with slack to align the first row
+	size_t storageBytes(int width, int height, size_t alignment)
+	{
+		return alignment + rowBytes(width, alignment) * height;
+	}
+}
+
+
+ResponsePool::ResponsePool(size_t max_buffers) :
+	m_max_buffers (std::max(max_buffers, (size_t)1)),
+	m_clock (0)
+{
+
+}
+
+ResponsePool::Buffer ResponsePool::acquire(int width, int height, size_t alignment)
+{
+	CV_Assert(width >= 0 && height >= 0);
+	CV_Assert(alignment >= sizeof(int16_t) && (alignment & (alignment - 1)) == 0);
+
+	m_clock++;
+
+	// Same key as before: the steady state
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		Entry &e = m_entries[i];
+		if (e.alignment == alignment && e.buffer.width == width && e.buffer.height == height)
+		{
+			e.last_use = m_clock;
+			return e.buffer;
+		}
+	}
+
+	// Re-key the smallest buffer that is large enough
+	const size_t needed = storageBytes(width, height, alignment);
+	Entry *best = NULL;
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		Entry &e = m_entries[i];
+		if (e.storage.size() >= needed && (!best || e.storage.size() < best->storage.size()))
+			best = &e;
+	}
+
+	if (!best)
+	{
+		if (m_entries.size() >= m_max_buffers)
+		{
+			// Drop the least recently used
+			size_t lru = 0;
+			for (size_t i = 1; i < m_entries.size(); i++)
+				if (m_entries[i].last_use < m_entries[lru].last_use)
+					lru = i;
+			m_entries.erase(m_entries.begin() + lru);
+		}
+		m_entries.push_back(Entry());
+		best = &m_entries.back();
+		best->storage.resize(needed);
+	}
+
+	layout(*best, width, height, alignment);
+	best->last_use = m_clock;
+	return best->buffer;
+}
+
+void ResponsePool::clear()
+{
+	m_entries.clear();
+}
+
+bool ResponsePool::layout(Entry &e, int width, int height, size_t alignment)
+{
+	if (e.storage.size() < storageBytes(width, height, alignment))
+		return false;
+
+	e.alignment = alignment;
+	e.buffer.data = (int16_t *)cv::alignPtr(&e.storage[0], (int)alignment);
+	e.buffer.stride = rowBytes(width, alignment) / sizeof(int16_t);
+	e.buffer.width = width;
+	e.buffer.height = height;
+	return true;
+}
@@ -0,0 +1,61 @@
+/*
+    ResponsePool class
+	Pool of aligned ChESS response buffers
+
+	Buffers are keyed by image size and row alignment, and are kept
+	between frames, so alternating between full frame and ROI detection,
+	or changing the capture resolution, does not reallocate in steady state.
+*/
+#ifndef RESPONSE_POOL_H
+#define RESPONSE_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+class ResponsePool
+{
+public:
+	// A response image of 'width' x 'height' int16 pixels.
+	// Row y starts at data + y * stride, every row is aligned.
+	struct Buffer
+	{
+		int16_t *data;
+		size_t stride;	// in elements
+		int width;
+		int height;
+	};
+
+	// Keep at most 'max_buffers' buffers, the least recently used is dropped
+	explicit ResponsePool(size_t max_buffers = 4);
+
+	// Get a buffer for a 'width' x 'height' response, with rows aligned
+	// to 'alignment' bytes (a power of two, at least 2).
+	// A buffer of the same key is returned as is. Otherwise the smallest
+	// buffer large enough is re-keyed, and only if there is none a new
+	// one is allocated. Contents are undefined, and a returned buffer is
+	// only valid until the next call.
+	Buffer acquire(int width, int height, size_t alignment = 64);
+
+	// Release all buffers
+	void clear();
+
+private:
+	struct Entry
+	{
+		std::vector<unsigned char> storage;
+		size_t alignment;
+		Buffer buffer;
+		unsigned long last_use;
+	};
+
+	// Point 'e' at a 'width' x 'height' layout, true if it fits
+	static bool layout(Entry &e, int width, int height, size_t alignment);
+
+	std::vector<Entry> m_entries;
+	size_t m_max_buffers;
+	unsigned long m_clock;
+};
+
+#endif		// RESPONSE_POOL_H
@@ -43,6 +43,7 @@
 // #include "precomp.hpp"
 #include "circlesgrid.hpp"
 #include <limits>
+#include <algorithm>
 //#define DEBUG_CIRCLES
 
 #include <opencv2/highgui.hpp>
@@ -69,91 +70,407 @@ void drawPoints(const std::vector<Point2f> &points, Mat &outImage, int radius =
 }
 // #endif
 
-void CirclesGridClusterFinder::hierarchicalClustering(const std::vector<Point2f> &points, const Size &patternSz, std::vector<Point2f> &patternPoints)
+namespace
 {
-#ifdef HAVE_TEGRA_OPTIMIZATION
-    if(tegra::useTegra() && tegra::hierarchicalClustering(points, patternSz, patternPoints))
-        return;
-#endif
-    int j, n = (int)points.size();
-    size_t pn = static_cast<size_t>(patternSz.area());
+  // Cone of 45 degrees of direction 'v', 0 to 7 counterclockwise from +x
+  inline int cone8(const Point2f &v)
+  {
+    if (v.y >= 0)
+    {
+      if (v.x > 0)
+        return v.x > v.y ? 0 : 1;
+      return -v.x < v.y ? 2 : 3;
+    }
+    if (v.x < 0)
+      return -v.x > -v.y ? 4 : 5;
+    return v.x < -v.y ? 6 : 7;
+  }
 
-    patternPoints.clear();
-    if (pn >= points.size())
+  int findRoot(std::vector<int> &parent, int i)
+  {
+    while (parent[i] != i)
     {
-        if (pn == points.size())
-            patternPoints = points;
-        return;
+      parent[i] = parent[parent[i]];
+      i = parent[i];
     }
+    return i;
+  }
+}
+
+CandidateIndex::CandidateIndex() :
+  pts(NULL), cell(1.f), gridWidth(0), gridHeight(0), searched(false), merged(false)
+{
+}
 
-    Mat dists(n, n, CV_32FC1, Scalar(0));
-    Mat distsMask(dists.size(), CV_8UC1, Scalar(0));
-    for(int i = 0; i < n; i++)
+void CandidateIndex::build(const std::vector<Point2f> &points)
+{
+  pts = &points;
+  searched = merged = false;
+  nearest.clear();
+  merges.clear();
+
+  const int n = (int)points.size();
+  pointCell.resize(n);
+  cellPoints.resize(n);
+  if (n == 0)
+  {
+    gridWidth = gridHeight = 0;
+    cellStart.assign(1, 0);
+    return;
+  }
+
+  lo = hi = points[0];
+  for (int i = 1; i < n; i++)
+  {
+    lo.x = std::min(lo.x, points[i].x);
+    lo.y = std::min(lo.y, points[i].y);
+    hi.x = std::max(hi.x, points[i].x);
+    hi.y = std::max(hi.y, points[i].y);
+  }
+  const float w = hi.x - lo.x, h = hi.y - lo.y;
+  cell = std::max(std::sqrt(w * h / n), std::max(w, h) / n);
+  if (!(cell > 0))
+    cell = 1.f;
+  gridWidth = (int)(w / cell) + 1;
+  gridHeight = (int)(h / cell) + 1;
+
+  // points of each cell, by counting sort
+  cellStart.assign(gridWidth * gridHeight + 1, 0);
+  for (int i = 0; i < n; i++)
+  {
+    const int cx = std::min((int)((points[i].x - lo.x) / cell), gridWidth - 1);
+    const int cy = std::min((int)((points[i].y - lo.y) / cell), gridHeight - 1);
+    pointCell[i] = cy * gridWidth + cx;
+    cellStart[pointCell[i] + 1]++;
+  }
+  for (int c = 0; c < gridWidth * gridHeight; c++)
+    cellStart[c + 1] += cellStart[c];
+  next.assign(cellStart.begin(), cellStart.end() - 1);
+  for (int i = 0; i < n; i++)
+    cellPoints[next[pointCell[i]]++] = i;
+}
+
+void CandidateIndex::searchCones(int i, const std::vector<uchar> *mask, unsigned cones, std::vector<Neighbour> &_found)
+{
+  const std::vector<Point2f> &points = *pts;
+  const Point2f &p = points[i];
+  const int cx = pointCell[i] % gridWidth, cy = pointCell[i] / gridWidth;
+  float best[8];
+  double bestSq[8];
+  std::fill(best, best + 8, std::numeric_limits<float>::max());
+  std::fill(bestSq, bestSq + 8, std::numeric_limits<double>::max());
+  candidates.clear();
+
+  // Farthest of the bounding box in each cone: a vertex of their
+  // intersection, a corner of the box or where a side of the cone
+  // leaves it. No point of the cone is farther
+  const Point2f corners[4] = {lo, Point2f(hi.x, lo.y), hi, Point2f(lo.x, hi.y)};
+  const float s = 0.70710678f;
+  const Point2f rays[8] = {Point2f(1, 0), Point2f(s, s), Point2f(0, 1), Point2f(-s, s),
+    Point2f(-1, 0), Point2f(-s, -s), Point2f(0, -1), Point2f(s, -s)};
+  float farthest[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  for (int c = 0; c < 4; c++)
+  {
+    const Point2f v = corners[c] - p;
+    const int cone = cone8(v);
+    farthest[cone] = std::max(farthest[cone], (float)norm(v));
+  }
+  for (int r = 0; r < 8; r++)
+  {
+    float t = std::numeric_limits<float>::max();
+    if (rays[r].x > 0.5f * s)
+      t = std::min(t, (hi.x - p.x) / rays[r].x);
+    else if (rays[r].x < -0.5f * s)
+      t = std::min(t, (lo.x - p.x) / rays[r].x);
+    if (rays[r].y > 0.5f * s)
+      t = std::min(t, (hi.y - p.y) / rays[r].y);
+    else if (rays[r].y < -0.5f * s)
+      t = std::min(t, (lo.y - p.y) / rays[r].y);
+    // ray r bounds cones r - 1 and r
+    farthest[r] = std::max(farthest[r], t);
+    farthest[(r + 7) & 7] = std::max(farthest[(r + 7) & 7], t);
+  }
+
+  const int maxRing = std::max(gridWidth, gridHeight);
+  for (int k = 0; k <= maxRing; k++)
+  {
+    // cells of the square ring k around the cell of point i
+    for (int y = std::max(cy - k, 0); y <= std::min(cy + k, gridHeight - 1); y++)
     {
-        for(j = i+1; j < n; j++)
+      const bool fullRow = y == cy - k || y == cy + k;
+      const int step = fullRow ? 1 : 2 * k;
+      for (int x = cx - k; x <= cx + k; x += step)
+      {
+        if (x < 0 || x >= gridWidth)
+          continue;
+        const int c = y * gridWidth + x;
+        for (int m = cellStart[c]; m < cellStart[c + 1]; m++)
         {
-            dists.at<float>(i, j) = (float)norm(points[i] - points[j]);
-            distsMask.at<uchar>(i, j) = 255;
-            //TODO: use symmetry
-            distsMask.at<uchar>(j, i) = 255;//distsMask.at<uchar>(i, j);
-            dists.at<float>(j, i) = dists.at<float>(i, j);
+          const int j = cellPoints[m];
+          if (j == i || (mask && (*mask)[j]))
+            continue;
+          // squared distance first, the distance (as in the matrix)
+          // only when it may be the nearest of the cone
+          const Point2f v = points[j] - p;
+          const int cone = cone8(v);
+          if (!(cones >> cone & 1))
+            continue;
+          const double distSq = (double)v.x * v.x + (double)v.y * v.y;
+          if (distSq > bestSq[cone] * (1 + 1e-6))
+            continue;
+          const float dist = (float)norm(p - points[j]);
+          if (dist <= best[cone])
+          {
+            best[cone] = dist;
+            bestSq[cone] = std::min(bestSq[cone], distSq);
+            Neighbour cand = {j, cone, dist};
+            candidates.push_back(cand);
+          }
         }
+      }
     }
 
-    std::vector<std::list<size_t> > clusters(points.size());
-    for(size_t i=0; i<points.size(); i++)
+    // the rings beyond are at least (k - 1) cells away (one cell of
+    // slack for the rounding of the cell indices)
+    const float reach = (k - 1) * cell;
+    bool done = true;
+    for (int cone = 0; cone < 8 && done; cone++)
+      done = !(cones >> cone & 1) || best[cone] < reach || farthest[cone] < reach;
+    if (done)
+      break;
+  }
+
+  for (size_t m = 0; m < candidates.size(); m++)
+    if (candidates[m].dist == best[candidates[m].cone])
+      _found.push_back(candidates[m]);
+}
+
+// The graph holds every edge single linkage can merge two clusters with:
+// if no point is nearer than |ab| to both a and b, b is the nearest to a
+// in its cone (a nearer point of the cone is nearer than |ab| to b too).
+// With a mask it is the graph of the other points: the nearest points of
+// a cone that are left stay the nearest, only the cones that lost all of
+// theirs are searched again. The distances are computed as in the dense
+// matrix
+void CandidateIndex::neighbourEdges(const std::vector<uchar> *mask)
+{
+  const int n = (int)pts->size();
+  if (!searched)
+  {
+    nearestStart.resize(n + 1);
+    for (int i = 0; i < n; i++)
     {
-        clusters[i].push_back(i);
+      nearestStart[i] = (int)nearest.size();
+      searchCones(i, NULL, 0xff, nearest);
     }
+    nearestStart[n] = (int)nearest.size();
+    searched = true;
+  }
 
-    int patternClusterIdx = 0;
-    while(clusters[patternClusterIdx].size() < pn)
+  edges.clear();
+  for (int i = 0; i < n; i++)
+  {
+    if (mask && (*mask)[i])
+      continue;
+    unsigned kept = 0, lost = 0;
+    for (int m = nearestStart[i]; m < nearestStart[i + 1]; m++)
     {
-        Point minLoc;
-        minMaxLoc(dists, 0, 0, &minLoc, 0, distsMask);
-        int minIdx = std::min(minLoc.x, minLoc.y);
-        int maxIdx = std::max(minLoc.x, minLoc.y);
-
-        distsMask.row(maxIdx).setTo(0);
-        distsMask.col(maxIdx).setTo(0);
-        Mat tmpRow = dists.row(minIdx);
-        Mat tmpCol = dists.col(minIdx);
-        cv::min(dists.row(minLoc.x), dists.row(minLoc.y), tmpRow);
-        tmpRow.copyTo(tmpCol);
-
-        clusters[minIdx].splice(clusters[minIdx].end(), clusters[maxIdx]);
-        patternClusterIdx = minIdx;
+      const Neighbour &nb = nearest[m];
+      if (mask && (*mask)[nb.idx])
+      {
+        lost |= 1u << nb.cone;
+        continue;
+      }
+      kept |= 1u << nb.cone;
+      Edge e = {nb.dist, std::min(i, nb.idx), std::max(i, nb.idx)};
+      edges.push_back(e);
     }
-
-    //the largest cluster can have more than pn points -- we need to filter out such situations
-    if(clusters[patternClusterIdx].size() != static_cast<size_t>(patternSz.area()))
+    lost &= ~kept;
+    if (!lost)
+      continue;
+    found.clear();
+    searchCones(i, mask, lost, found);
+    for (size_t m = 0; m < found.size(); m++)
     {
-      return;
+      Edge e = {found[m].dist, std::min(i, found[m].idx), std::max(i, found[m].idx)};
+      edges.push_back(e);
     }
+  }
+
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+}
+
+// Kruskal: the edges of the Euclidean minimum spanning tree by increasing
+// length. Equal lengths are merged in the order the dense matrix search
+// would: the pair of smallest cluster indices (smallest point index of
+// the cluster, also its root) first
+void CandidateIndex::singleLinkage(std::vector<Merge> &_merges)
+{
+  const int n = (int)pts->size();
+  _merges.clear();
+  parent.resize(n);
+  clusterSize.assign(n, 1);
+  for (int i = 0; i < n; i++)
+    parent[i] = i;
 
-    patternPoints.reserve(clusters[patternClusterIdx].size());
-    for(std::list<size_t>::iterator it = clusters[patternClusterIdx].begin(); it != clusters[patternClusterIdx].end(); it++)
+  for (size_t s = 0, e = 0; s < edges.size(); s = e)
+  {
+    e = s + 1;
+    while (e < edges.size() && edges[e].dist == edges[s].dist)
+      e++;
+
+    for (;;)
     {
-        patternPoints.push_back(points[*it]);
+      int ra = -1, rb = -1;
+      for (size_t k = s; k < e; k++)
+      {
+        int a = findRoot(parent, edges[k].a), b = findRoot(parent, edges[k].b);
+        if (a == b)
+          continue;
+        if (a > b)
+          std::swap(a, b);
+        if (ra < 0 || a < ra || (a == ra && b < rb))
+        {
+          ra = a;
+          rb = b;
+        }
+      }
+      if (ra < 0)
+        break;
+
+      parent[rb] = ra;
+      clusterSize[ra] += clusterSize[rb];
+      Merge m = {ra, rb, clusterSize[ra]};
+      _merges.push_back(m);
+      if (e - s == 1)
+        break;
     }
+  }
+}
+
+void CandidateIndex::cluster(size_t pn, const std::vector<uchar> *mask, std::vector<Point2f> &patternPoints)
+{
+  clusterIndices(pn, mask, clustered);
+  patternPoints.resize(clustered.size());
+  for (size_t i = 0; i < clustered.size(); i++)
+    patternPoints[i] = (*pts)[clustered[i]];
+}
+
+void CandidateIndex::clusterIndices(size_t pn, const std::vector<uchar> *mask, std::vector<int> &patternIndices)
+{
+  const int n = (int)pts->size();
+  patternIndices.clear();
+
+  int first = -1;
+  size_t active = 0;
+  for (int i = 0; i < n; i++)
+  {
+    if (mask && (*mask)[i])
+      continue;
+    if (first < 0)
+      first = i;
+    active++;
+  }
+  if (pn >= active)
+  {
+    if (pn == active)
+      for (int i = 0; i < n; i++)
+        if (!mask || !(*mask)[i])
+          patternIndices.push_back(i);
+    return;
+  }
+  // a single point is a cluster before any merge
+  if (pn <= 1)
+  {
+    if (pn == 1)
+      patternIndices.push_back(first);
+    return;
+  }
+
+  const std::vector<Merge> *sequence = &merges;
+  if (mask)
+  {
+    neighbourEdges(mask);
+    singleLinkage(maskedMerges);
+    sequence = &maskedMerges;
+  }
+  else if (!merged)
+  {
+    neighbourEdges(NULL);
+    singleLinkage(merges);
+    merged = true;
+  }
+
+  size_t last = 0;
+  while (last < sequence->size() && static_cast<size_t>((*sequence)[last].size) < pn)
+    last++;
+  //the largest cluster can have more than pn points -- we need to filter out such situations
+  if (last == sequence->size() || static_cast<size_t>((*sequence)[last].size) != pn)
+    return;
+
+  // points of the cluster in merge order: each cluster is a list
+  // starting at its root, the lists are appended
+  next.assign(n, -1);
+  tail.resize(n);
+  for (int i = 0; i < n; i++)
+    tail[i] = i;
+  for (size_t k = 0; k <= last; k++)
+  {
+    const Merge &m = (*sequence)[k];
+    next[tail[m.a]] = m.b;
+    tail[m.a] = tail[m.b];
+  }
+  patternIndices.reserve(pn);
+  for (int i = (*sequence)[last].a; i >= 0; i = next[i])
+    patternIndices.push_back(i);
+}
+
+// Single linkage, merging the two nearest clusters until one has the points
+// of the pattern. The merges are taken from a neighbour graph instead of a
+// dense distance matrix (O(n log n) rather than O(n^3)), with the same
+// clusters and point order as the matrix version (CandidateIndex)
+void CirclesGridClusterFinder::hierarchicalClustering(const std::vector<Point2f> &points, const Size &patternSz, std::vector<Point2f> &patternPoints)
+{
+#ifdef HAVE_TEGRA_OPTIMIZATION
+    if(tegra::useTegra() && tegra::hierarchicalClustering(points, patternSz, patternPoints))
+        return;
+#endif
+    CandidateIndex index;
+    index.build(points);
+    index.cluster(static_cast<size_t>(patternSz.area()), NULL, patternPoints);
 }
 
 void CirclesGridClusterFinder::findGrid(const std::vector<cv::Point2f> &points, cv::Size _patternSize, std::vector<Point2f>& centers)
 {
+  CandidateIndex index;
+  index.build(points);
+  findGrid(index, _patternSize, centers);
+}
+
+void CirclesGridClusterFinder::findGrid(CandidateIndex &index, cv::Size _patternSize, std::vector<Point2f>& centers,
+                                        const std::vector<uchar> *ex_mask)
+{
+  const std::vector<Point2f> &points = index.points();
+  CV_Assert(!ex_mask || ex_mask->size() == points.size());
   patternSize = _patternSize;
   centers.clear();
+  centerIndices.clear();
   
   if(points.empty())
   {
     return;
   }
 
-  std::vector<Point2f> patternPoints;
-  hierarchicalClustering(points, patternSize, patternPoints);
-  if(patternPoints.empty())
+  std::vector<int> patternIndices;
+  index.clusterIndices(static_cast<size_t>(patternSize.area()), ex_mask, patternIndices);
+  if(patternIndices.empty())
   {
     return;
   }
+  std::vector<Point2f> patternPoints(patternIndices.size());
+  for(size_t i = 0; i < patternIndices.size(); i++)
+    patternPoints[i] = points[patternIndices[i]];
 
 #ifdef DEBUG_CIRCLES
   Mat patternPointsImage(1024, 1248, CV_8UC1, Scalar(0));
@@ -184,12 +501,13 @@ void CirclesGridClusterFinder::findGrid(const std::vector<cv::Point2f> &points,
   if(sortedCorners.size() != cornersCount)
     return;
 
+  // rectified points are in the order of patternPoints (and patternIndices)
   std::vector<Point2f> rectifiedPatternPoints;
   rectifyPatternPoints(patternPoints, sortedCorners, rectifiedPatternPoints);
   if(patternPoints.size() != rectifiedPatternPoints.size())
     return;
 
-  parsePatternPoints(patternPoints, rectifiedPatternPoints, centers);
+  parsePatternPoints(patternPoints, patternIndices, rectifiedPatternPoints, centers);
 
   // Distinguish asymmetric seg from symmetric
   if (isSingleLine && isAsymmetricGrid)
@@ -198,15 +516,8 @@ void CirclesGridClusterFinder::findGrid(const std::vector<cv::Point2f> &points,
 	  asym_short_seg_mask.resize(points.size(), 0);
 
 	  // For single line asymmetric grid, odd points (0-based) is short segment
-	  for (int i = 1; i < centers.size(); i+=2)
-	  {
-		  // Note: centers.size() < points.size()
-		  int pos = std::find(points.begin(), points.end(), centers[i]) - points.begin();
-		  if(pos < points.size()) {
-			  // found
-			  asym_short_seg_mask[pos] = 1;
-		  }
-	  }
+	  for (size_t i = 1; i < centerIndices.size(); i+=2)
+		  asym_short_seg_mask[centerIndices[i]] = 1;
   }
 }
 
@@ -215,14 +526,9 @@ void CirclesGridClusterFinder::findGridwithExMask(const std::vector<cv::Point2f>
 	const int num_input_pts = (int)points.size();
 	CV_Assert(num_input_pts == (int)mask.size());
 
-	std::vector<cv::Point2f> filter_points;
-
-	for (int i = 0; i < num_input_pts; i++)
-	{
-		if (!mask[i])
-			filter_points.push_back(points[i]);
-	}
-	findGrid(filter_points, patternSize, centers);
+	CandidateIndex index;
+	index.build(points);
+	findGrid(index, patternSize, centers, &mask);
 }
 
 void CirclesGridClusterFinder::findCorners(const std::vector<cv::Point2f> &hull2f, std::vector<cv::Point2f> &corners, const int _cornersCount)
@@ -460,12 +766,13 @@ void CirclesGridClusterFinder::rectifyPatternPoints(const std::vector<cv::Point2
   convertPointsFromHomogeneous(rectifiedPointsMat, rectifiedPatternPoints);
 }
 
-void CirclesGridClusterFinder::parsePatternPoints(const std::vector<cv::Point2f> &patternPoints, const std::vector<cv::Point2f> &rectifiedPatternPoints, std::vector<cv::Point2f> &centers)
+void CirclesGridClusterFinder::parsePatternPoints(const std::vector<cv::Point2f> &patternPoints, const std::vector<int> &patternIndices, const std::vector<cv::Point2f> &rectifiedPatternPoints, std::vector<cv::Point2f> &centers)
 {
   flann::LinearIndexParams flannIndexParams;
   flann::Index flannIndex(Mat(rectifiedPatternPoints).reshape(1), flannIndexParams);
 
   centers.clear();
+  centerIndices.clear();
   for( int i = 0; i < patternSize.height; i++ )
   {
     for( int j = 0; j < patternSize.width; j++ )
@@ -484,6 +791,7 @@ void CirclesGridClusterFinder::parsePatternPoints(const std::vector<cv::Point2f>
       Mat dists(1, knn, CV_32F, &distsbuf);
       flannIndex.knnSearch(query, indices, dists, knn, flann::SearchParams());
       centers.push_back(patternPoints.at(indicesbuf[0]));
+      centerIndices.push_back(patternIndices.at(indicesbuf[0]));
 
       if(distsbuf[0] > maxRectifiedDistance)
       {
@@ -491,13 +799,15 @@ void CirclesGridClusterFinder::parsePatternPoints(const std::vector<cv::Point2f>
         cout << "Pattern not detected: too large rectified distance" << endl;
 #endif
         centers.clear();
+        centerIndices.clear();
         return;
       }
     }
   }
 }
 
-Graph::Graph(size_t n)
+Graph::Graph(size_t n) :
+  verticesCount(0), words(0)
 {
   for (size_t i = 0; i < n; i++)
   {
@@ -507,14 +817,27 @@ Graph::Graph(size_t n)
 
 bool Graph::doesVertexExist(size_t id) const
 {
-  return (vertices.find(id) != vertices.end());
+  return id < verticesCount;
 }
 
 void Graph::addVertex(size_t id)
 {
-  CV_Assert( !doesVertexExist( id ) );
+  CV_Assert( id == verticesCount );
 
-  vertices.insert(std::pair<size_t, Vertex> (id, Vertex()));
+  const size_t newWords = (verticesCount + 64) / 64;
+  if (newWords != words)
+  {
+    // wider rows
+    std::vector<uint64_t> wider((verticesCount + 1) * newWords, 0);
+    for (size_t i = 0; i < verticesCount; i++)
+      std::copy(row(i), row(i) + words, &wider[i * newWords]);
+    adjacency.swap(wider);
+    words = newWords;
+  }
+  else
+    adjacency.resize((verticesCount + 1) * words, 0);
+  degrees.push_back(0);
+  verticesCount++;
 }
 
 void Graph::addEdge(size_t id1, size_t id2)
@@ -522,8 +845,14 @@ void Graph::addEdge(size_t id1, size_t id2)
   CV_Assert( doesVertexExist( id1 ) );
   CV_Assert( doesVertexExist( id2 ) );
 
-  vertices[id1].neighbors.insert(id2);
-  vertices[id2].neighbors.insert(id1);
+  if (areVerticesAdjacent(id1, id2))
+    return;
+  row(id1)[id2 / 64] |= (uint64_t)1 << (id2 % 64);
+  degrees[id1]++;
+  if (id1 == id2)
+    return;
+  row(id2)[id1 / 64] |= (uint64_t)1 << (id1 % 64);
+  degrees[id2]++;
 }
 
 void Graph::removeEdge(size_t id1, size_t id2)
@@ -531,8 +860,14 @@ void Graph::removeEdge(size_t id1, size_t id2)
   CV_Assert( doesVertexExist( id1 ) );
   CV_Assert( doesVertexExist( id2 ) );
 
-  vertices[id1].neighbors.erase(id2);
-  vertices[id2].neighbors.erase(id1);
+  if (!areVerticesAdjacent(id1, id2))
+    return;
+  row(id1)[id2 / 64] &= ~((uint64_t)1 << (id2 % 64));
+  degrees[id1]--;
+  if (id1 == id2)
+    return;
+  row(id2)[id1 / 64] &= ~((uint64_t)1 << (id1 % 64));
+  degrees[id2]--;
 }
 
 bool Graph::areVerticesAdjacent(size_t id1, size_t id2) const
@@ -540,68 +875,86 @@ bool Graph::areVerticesAdjacent(size_t id1, size_t id2) const
   CV_Assert( doesVertexExist( id1 ) );
   CV_Assert( doesVertexExist( id2 ) );
 
-  Vertices::const_iterator it = vertices.find(id1);
-  return it->second.neighbors.find(id2) != it->second.neighbors.end();
+  return (row(id1)[id2 / 64] >> (id2 % 64) & 1) != 0;
 }
 
 size_t Graph::getVerticesCount() const
 {
-  return vertices.size();
+  return verticesCount;
 }
 
 size_t Graph::getDegree(size_t id) const
 {
   CV_Assert( doesVertexExist(id) );
 
-  Vertices::const_iterator it = vertices.find(id);
-  return it->second.neighbors.size();
+  return degrees[id];
 }
 
-void Graph::floydWarshall(cv::Mat &distanceMatrix, int infinity) const
+namespace
 {
-  const int edgeWeight = 1;
-
-  const int n = (int)getVerticesCount();
-  distanceMatrix.create(n, n, CV_32SC1);
-  distanceMatrix.setTo(infinity);
-  for (Vertices::const_iterator it1 = vertices.begin(); it1 != vertices.end(); it1++)
+  // Index of the lowest set bit of 'bits' (not 0)
+  inline int lowestBit(uint64_t bits)
   {
-    distanceMatrix.at<int> ((int)it1->first, (int)it1->first) = 0;
-    for (Neighbors::const_iterator it2 = it1->second.neighbors.begin(); it2 != it1->second.neighbors.end(); it2++)
+    int b = 0;
+    while (!(bits & 1))
     {
-      CV_Assert( it1->first != *it2 );
-      distanceMatrix.at<int> ((int)it1->first, (int)*it2) = edgeWeight;
+      bits >>= 1;
+      b++;
     }
+    return b;
   }
+}
 
-  for (Vertices::const_iterator it1 = vertices.begin(); it1 != vertices.end(); it1++)
-  {
-    for (Vertices::const_iterator it2 = vertices.begin(); it2 != vertices.end(); it2++)
+void Graph::shortestPaths(cv::Mat &distanceMatrix, int infinity) const
+{
+  const int n = (int)verticesCount;
+  distanceMatrix.create(n, n, CV_32SC1);
+  distanceMatrix.setTo(infinity);
+
+  // unvisited vertices, taken out of the rows of the frontier
+  std::vector<uint64_t> unvisited(words);
+  std::vector<int> queue(n);
+  for (int source = 0; source < n; source++)
+  {
+    int *dist = distanceMatrix.ptr<int>(source);
+    std::fill(unvisited.begin(), unvisited.end(), ~(uint64_t)0);
+    unvisited[source / 64] &= ~((uint64_t)1 << (source % 64));
+    dist[source] = 0;
+    int head = 0, tail = 0;
+    queue[tail++] = source;
+    while (head < tail)
     {
-      for (Vertices::const_iterator it3 = vertices.begin(); it3 != vertices.end(); it3++)
+      const int v = queue[head++];
+      const uint64_t *neighbors = row(v);
+      for (size_t w = 0; w < words; w++)
       {
-      int i1 = (int)it1->first, i2 = (int)it2->first, i3 = (int)it3->first;
-        int val1 = distanceMatrix.at<int> (i2, i3);
-        int val2;
-        if (distanceMatrix.at<int> (i2, i1) == infinity ||
-      distanceMatrix.at<int> (i1, i3) == infinity)
-          val2 = val1;
-        else
+        uint64_t bits = neighbors[w] & unvisited[w];
+        unvisited[w] &= ~bits;
+        while (bits)
         {
-          val2 = distanceMatrix.at<int> (i2, i1) + distanceMatrix.at<int> (i1, i3);
+          const int u = (int)(w * 64) + lowestBit(bits);
+          bits &= bits - 1;
+          dist[u] = dist[v] + 1;
+          queue[tail++] = u;
         }
-        distanceMatrix.at<int> (i2, i3) = (val1 == infinity) ? val2 : std::min(val1, val2);
       }
     }
   }
 }
 
-const Graph::Neighbors& Graph::getNeighbors(size_t id) const
+Graph::Neighbors Graph::getNeighbors(size_t id) const
 {
   CV_Assert( doesVertexExist(id) );
 
-  Vertices::const_iterator it = vertices.find(id);
-  return it->second.neighbors;
+  Neighbors neighbors;
+  neighbors.reserve(degrees[id]);
+  const uint64_t *bits = row(id);
+  for (size_t w = 0; w < words; w++)
+  {
+    for (uint64_t b = bits[w]; b; b &= b - 1)
+      neighbors.push_back(w * 64 + lowestBit(b));
+  }
+  return neighbors;
 }
 
 CirclesGridFinder::Segment::Segment(cv::Point2f _s, cv::Point2f _e) :
@@ -610,7 +963,7 @@ CirclesGridFinder::Segment::Segment(cv::Point2f _s, cv::Point2f _e) :
 }
 
 void computeShortestPath(Mat &predecessorMatrix, int v1, int v2, std::vector<int> &path);
-void computePredecessorMatrix(const Mat &dm, int verticesCount, Mat &predecessorMatrix);
+void computePredecessorMatrix(const Graph &g, const Mat &dm, Mat &predecessorMatrix);
 
 CirclesGridFinderParameters::CirclesGridFinderParameters()
 {
@@ -1279,21 +1632,31 @@ void CirclesGridFinder::computeRNG(Graph &rng, std::vector<cv::Point2f> &vectors
   }
 }
 
-void computePredecessorMatrix(const Mat &dm, int verticesCount, Mat &predecessorMatrix)
+// Predecessor of j on a shortest path from i: the neighbor of j of smallest
+// index one step nearer to i, -1 for i itself and the vertices out of reach
+void computePredecessorMatrix(const Graph &g, const Mat &dm, Mat &predecessorMatrix)
 {
   CV_Assert( dm.type() == CV_32SC1 );
+  const int verticesCount = (int)g.getVerticesCount();
   predecessorMatrix.create(verticesCount, verticesCount, CV_32SC1);
   predecessorMatrix = -1;
+  std::vector<Graph::Neighbors> neighbors(verticesCount);
+  for (int j = 0; j < verticesCount; j++)
+    neighbors[j] = g.getNeighbors(j);
+
   for (int i = 0; i < predecessorMatrix.rows; i++)
   {
+    const int *dist = dm.ptr<int>(i);
+    int *pred = predecessorMatrix.ptr<int>(i);
     for (int j = 0; j < predecessorMatrix.cols; j++)
     {
-      int dist = dm.at<int> (i, j);
-      for (int k = 0; k < verticesCount; k++)
+      if (dist[j] <= 0)
+        continue;
+      for (size_t k = 0; k < neighbors[j].size(); k++)
       {
-        if (dm.at<int> (i, k) == dist - 1 && dm.at<int> (k, j) == 1)
+        if (dist[neighbors[j][k]] == dist[j] - 1)
         {
-          predecessorMatrix.at<int> (i, j) = k;
+          pred[j] = (int)neighbors[j][k];
           break;
         }
       }
@@ -1324,9 +1687,9 @@ size_t CirclesGridFinder::findLongestPath(std::vector<Graph> &basisGraphs, Path
   {
     const Graph &g = basisGraphs[graphIdx];
     Mat distanceMatrix;
-    g.floydWarshall(distanceMatrix, infinity);
+    g.shortestPaths(distanceMatrix, infinity);
     Mat predecessorMatrix;
-    computePredecessorMatrix(distanceMatrix, (int)g.getVerticesCount(), predecessorMatrix);
+    computePredecessorMatrix(g, distanceMatrix, predecessorMatrix);
 
     double maxVal;
     Point maxLoc;
@@ -49,6 +49,7 @@
 #include <numeric>
 #include <map>
 #include <vector>
+#include <stdint.h>
 
 #include "opencv2/calib3d.hpp"
 #include "opencv2/imgproc.hpp"
@@ -57,6 +58,95 @@
 
 // #include "precomp.hpp"
 
+// Candidate points of a frame, shared by the grid finders run on them:
+// a grid of the points for the neighbour queries and the single linkage
+// merges of all of them, both built once. Points can be left out by a
+// mask, which is a view of the index (no copy of the points)
+class CandidateIndex
+{
+public:
+  CandidateIndex();
+
+  // Index 'points', kept by reference until the next build
+  void build(const std::vector<cv::Point2f> &points);
+
+  inline const std::vector<cv::Point2f> &points() const { return *pts; }
+
+  // Points of the first single linkage cluster reaching 'pn' points, in
+  // merge order (as hierarchicalClustering), empty if it has more.
+  // Points with (*mask)[i] != 0 are left out (NULL: none)
+  void cluster(size_t pn, const std::vector<uchar> *mask, std::vector<cv::Point2f> &patternPoints);
+  // Same, giving the indices of the points
+  void clusterIndices(size_t pn, const std::vector<uchar> *mask, std::vector<int> &patternIndices);
+
+private:
+  // Edge of the neighbour graph, 'a' < 'b'
+  struct Edge
+  {
+    float dist;
+    int a, b;
+
+    bool operator<(const Edge &e) const
+    {
+      if (dist != e.dist)
+        return dist < e.dist;
+      return a < e.a || (a == e.a && b < e.b);
+    }
+    bool operator==(const Edge &e) const
+    {
+      return dist == e.dist && a == e.a && b == e.b;
+    }
+  };
+
+  // Cluster 'b' appended to cluster 'a' (both by their smallest point
+  // index), giving 'size' points
+  struct Merge
+  {
+    int a, b, size;
+  };
+
+  // Nearest point 'idx' in cone 'cone' (ties give several)
+  struct Neighbour
+  {
+    int idx, cone;
+    float dist;
+  };
+
+  // Append to 'found' the nearest points to point 'i' in each of the
+  // cones set in the bits of 'cones', skipping the points masked out
+  void searchCones(int i, const std::vector<uchar> *mask, unsigned cones, std::vector<Neighbour> &found);
+
+  // Edges from each point not masked out to its nearest points in each
+  // of 8 cones of 45 degrees, sorted, no duplicates
+  void neighbourEdges(const std::vector<uchar> *mask);
+
+  // Single linkage merges of 'edges' until all points are connected
+  void singleLinkage(std::vector<Merge> &_merges);
+
+  const std::vector<cv::Point2f> *pts;
+
+  // grid of about one point per cell: bounding box, cell size,
+  // cell of each point and points of each cell
+  cv::Point2f lo, hi;
+  float cell;
+  int gridWidth, gridHeight;
+  std::vector<int> pointCell, cellStart, cellPoints;
+
+  // nearest points in each cone of all the points (those of point i
+  // from nearestStart[i]) and their merges, computed on first use
+  bool searched, merged;
+  std::vector<Neighbour> nearest;
+  std::vector<int> nearestStart;
+  std::vector<Merge> merges;
+
+  // scratch: cone search, edges, merges of a masked view, union-find,
+  // point lists, cluster indices
+  std::vector<Neighbour> candidates, found;
+  std::vector<Edge> edges;
+  std::vector<Merge> maskedMerges;
+  std::vector<int> parent, clusterSize, next, tail, clustered;
+};
+
 class CirclesGridClusterFinder
 {
     CirclesGridClusterFinder& operator=(const CirclesGridClusterFinder&);
@@ -70,6 +160,9 @@ public:
     maxRectifiedDistance = (float)(squareSize / 2.0);
   }
   void findGrid(const std::vector<cv::Point2f> &points, cv::Size patternSize, std::vector<cv::Point2f>& centers);
+  // Same on the points of 'index', leaving out those with (*ex_mask)[i] = 1
+  void findGrid(CandidateIndex &index, cv::Size patternSize, std::vector<cv::Point2f>& centers,
+    const std::vector<uchar> *ex_mask = NULL);
   // Only used the points set by ex_mask which is same size as points
   // NOTE: ex_mask[i] = 1 when the point should be EXCLUDED
   void findGridwithExMask(const std::vector<cv::Point2f> &points, cv::Size patternSize, const std::vector<uchar> &ex_mask, std::vector<cv::Point2f>& centers);
@@ -78,12 +171,17 @@ public:
   void hierarchicalClustering(const std::vector<cv::Point2f> &points, const cv::Size &patternSize, std::vector<cv::Point2f> &patternPoints);
 
   inline std::vector<uchar> getAsmSegMask() {return asym_short_seg_mask;}
+  // Index in the input points of each centre of the last findGrid,
+  // empty if no grid was found
+  inline const std::vector<int> &getCenterIndices() const {return centerIndices;}
 private:
   void findCorners(const std::vector<cv::Point2f> &hull2f, std::vector<cv::Point2f> &corners, const int _cornersCount = 0);
   void findOutsideCorners(const std::vector<cv::Point2f> &corners, std::vector<cv::Point2f> &outsideCorners);
   void getSortedCorners(const std::vector<cv::Point2f> &hull2f, const std::vector<cv::Point2f> &corners, const std::vector<cv::Point2f> &outsideCorners, std::vector<cv::Point2f> &sortedCorners);
   void rectifyPatternPoints(const std::vector<cv::Point2f> &patternPoints, const std::vector<cv::Point2f> &sortedCorners, std::vector<cv::Point2f> &rectifiedPatternPoints);
-  void parsePatternPoints(const std::vector<cv::Point2f> &patternPoints, const std::vector<cv::Point2f> &rectifiedPatternPoints, std::vector<cv::Point2f> &centers);
+  // 'patternIndices' are the input indices of 'patternPoints', giving
+  // those of the centres in 'centerIndices'
+  void parsePatternPoints(const std::vector<cv::Point2f> &patternPoints, const std::vector<int> &patternIndices, const std::vector<cv::Point2f> &rectifiedPatternPoints, std::vector<cv::Point2f> &centers);
 
   float squareSize, maxRectifiedDistance;
   bool isAsymmetricGrid;
@@ -93,19 +191,19 @@ private:
   // Mask is 1 when it is shorter segment of single line asymmetric grid
   std::vector<uchar> asym_short_seg_mask;
   std::vector<cv::Point2f> asym_short_seg_points;
+  std::vector<int> centerIndices;
 };
 
+// Undirected graph of vertices 0 to n - 1. The adjacency is a bit matrix,
+// a row of 64 bit words per vertex: the graphs of the finder have a vertex
+// per keypoint, so there are few of them and a row is a few words
 class Graph
 {
 public:
-  typedef std::set<size_t> Neighbors;
-  struct Vertex
-  {
-    Neighbors neighbors;
-  };
-  typedef std::map<size_t, Vertex> Vertices;
+  typedef std::vector<size_t> Neighbors;
 
   Graph(size_t n);
+  // 'id' must be the next vertex, getVerticesCount()
   void addVertex(size_t id);
   void addEdge(size_t id1, size_t id2);
   void removeEdge(size_t id1, size_t id2);
@@ -113,10 +211,19 @@ public:
   bool areVerticesAdjacent(size_t id1, size_t id2) const;
   size_t getVerticesCount() const;
   size_t getDegree(size_t id) const;
-  const Neighbors& getNeighbors(size_t id) const;
-  void floydWarshall(cv::Mat &distanceMatrix, int infinity = -1) const;
+  // neighbors of 'id' in increasing order
+  Neighbors getNeighbors(size_t id) const;
+  // Length of the shortest path between each two vertices, all edges
+  // having length 1, by a breadth first search from each vertex.
+  // 'infinity' if there is none
+  void shortestPaths(cv::Mat &distanceMatrix, int infinity = -1) const;
 private:
-  Vertices vertices;
+  inline const uint64_t *row(size_t id) const { return &adjacency[id * words]; }
+  inline uint64_t *row(size_t id) { return &adjacency[id * words]; }
+
+  size_t verticesCount, words;
+  std::vector<uint64_t> adjacency;
+  std::vector<size_t> degrees;
 };
 
 struct Path
@@ -0,0 +1,130 @@
+#include "motion_predictor.h"
+#include <algorithm>
+#include <cmath>
+
+void MotionPredictor::Axis::init(float z, float meas_noise, float vel_var)
+{
+	x = z;
+	v = 0;
+	p00 = meas_noise;
+	p01 = 0;
+	p11 = vel_var;
+}
+
+void MotionPredictor::Axis::predict(float q)
+{
+	// x' = x + v, P' = F P F^T + q [1/4 1/2; 1/2 1]
+	x += v;
+	p00 += 2 * p01 + p11 + q / 4;
+	p01 += p11 + q / 2;
+	p11 += q;
+}
+
+void MotionPredictor::Axis::correct(float z, float r)
+{
+	float s = p00 + r;
+	float k0 = p00 / s, k1 = p01 / s;
+	float innovation = z - x;
+	x += k0 * innovation;
+	v += k1 * innovation;
+	p11 -= k1 * p01;
+	p01 *= 1 - k0;
+	p00 *= 1 - k0;
+}
+
+MotionPredictor::MotionPredictor(float accel_noise, float meas_noise) :
+	m_accel_noise(accel_noise), m_meas_noise(meas_noise),
+	m_init(false), m_aspect_x(1), m_aspect_y(1),
+	m_pending(false), m_predictions(0), m_hits(0)
+{
+}
+
+void MotionPredictor::reset()
+{
+	m_init = false;
+	m_pending = false;
+}
+
+void MotionPredictor::predict()
+{
+	if (!m_init)
+		return;
+	m_x.predict(m_accel_noise);
+	m_y.predict(m_accel_noise);
+	m_s.predict(m_accel_noise / 16);
+	m_pending = true;
+	m_predictions++;
+}
+
+void MotionPredictor::correct(const std::vector<cv::Point2f> &pts)
+{
+	if (pts.empty())
+		return;
+
+	cv::Point2f c(0, 0), lo = pts[0], hi = pts[0];
+	for (size_t i = 0; i < pts.size(); i++)
+	{
+		c += pts[i];
+		lo.x = std::min(lo.x, pts[i].x);
+		lo.y = std::min(lo.y, pts[i].y);
+		hi.x = std::max(hi.x, pts[i].x);
+		hi.y = std::max(hi.y, pts[i].y);
+	}
+	c *= 1.f / pts.size();
+	float ss = 0;
+	for (size_t i = 0; i < pts.size(); i++)
+	{
+		cv::Point2f d = pts[i] - c;
+		ss += d.dot(d);
+	}
+	const float scale = std::max(std::sqrt(ss / pts.size()), 1.f);
+
+	if (m_pending)
+	{
+		// the prediction was a hit if its window held all the dots
+		const cv::Point2f half = halfSize(1.f);
+		if (lo.x >= m_x.x - half.x && hi.x <= m_x.x + half.x &&
+			lo.y >= m_y.x - half.y && hi.y <= m_y.x + half.y)
+			m_hits++;
+		m_pending = false;
+	}
+
+	if (!m_init)
+	{
+		// velocity unknown: up to ~30 pixels per frame
+		m_x.init(c.x, m_meas_noise, 900.f);
+		m_y.init(c.y, m_meas_noise, 900.f);
+		m_s.init(scale, m_meas_noise, 25.f);
+		m_init = true;
+	}
+	else
+	{
+		m_x.correct(c.x, m_meas_noise);
+		m_y.correct(c.y, m_meas_noise);
+		m_s.correct(scale, m_meas_noise);
+	}
+
+	m_aspect_x = std::max(c.x - lo.x, hi.x - c.x) / scale;
+	m_aspect_y = std::max(c.y - lo.y, hi.y - c.y) / scale;
+}
+
+cv::Point2f MotionPredictor::halfSize(float scale) const
+{
+	// extent of the dots at the predicted scale, plus the dots themselves
+	// and two standard deviations of the predicted centroid
+	const float s = std::max(m_s.x + 2 * std::sqrt(m_s.p00), 1.f);
+	const float margin = std::max(0.25f * s, 8.f);
+	return cv::Point2f(
+		scale * (m_aspect_x * s + margin + 2 * std::sqrt(m_x.p00)),
+		scale * (m_aspect_y * s + margin + 2 * std::sqrt(m_y.p00)));
+}
+
+cv::Rect MotionPredictor::window(const cv::Size &img_size, float scale) const
+{
+	if (!m_init)
+		return cv::Rect();
+	const cv::Point2f half = halfSize(scale);
+	cv::Rect rect(cvFloor(m_x.x - half.x), cvFloor(m_y.x - half.y),
+		cvCeil(2 * half.x) + 1, cvCeil(2 * half.y) + 1);
+	return rect & cv::Rect(0, 0, img_size.width, img_size.height);
+}
@@ -0,0 +1,79 @@
+/*
+	MotionPredictor class
+
+	Predicts where the marker will be in the next frame, to place the
+	detection ROI. Constant velocity Kalman filter on the centroid (x, y)
+	and scale (RMS distance of the dots to their centroid) of the marker.
+	The model and noises are separable, so the filter is run as three
+	independent position/velocity filters (2x2 covariances), the same as
+	the 6 state filter with block diagonal matrices.
+*/
+
+
+#ifndef MOTION_PREDICTOR_H
+#define MOTION_PREDICTOR_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+class MotionPredictor
+{
+public:
+	// 'accel_noise': variance of the acceleration (pixels^2 / frame^4)
+	// 'meas_noise': variance of the measured centroid and scale (pixels^2)
+	MotionPredictor(float accel_noise = 4.f, float meas_noise = 1.f);
+
+	// Forget the marker (lost)
+	void reset();
+
+	inline bool initialised() const { return m_init; }
+
+	// Predict the marker in the next frame, once per frame before correct()
+	void predict();
+
+	// Marker dots 'pts' measured in the current frame
+	void correct(const std::vector<cv::Point2f> &pts);
+
+	// ROI around the predicted marker, its half size 'scale' times larger,
+	// clipped to an image of 'img_size'
+	cv::Rect window(const cv::Size &img_size, float scale = 1.f) const;
+
+	// Estimated motion of the centroid per frame
+	inline cv::Point2f velocity() const { return cv::Point2f(m_x.v, m_y.v); }
+
+	// Fraction of the predictions whose window contained all the dots
+	// measured next, 0 if none was made
+	inline float hitRate() const { return m_predictions ? (float)m_hits / m_predictions : 0.f; }
+	inline int predictions() const { return m_predictions; }
+
+private:
+	// Position and velocity along one axis, with their covariance
+	struct Axis
+	{
+		float x, v;
+		float p00, p01, p11;
+
+		void init(float z, float meas_noise, float vel_var);
+		void predict(float accel_noise);
+		void correct(float z, float meas_noise);
+	};
+
+	// Half size of the predicted window
+	cv::Point2f halfSize(float scale) const;
+
+	float m_accel_noise;
+	float m_meas_noise;
+
+	bool m_init;
+	Axis m_x, m_y, m_s;
+
+	// half extents of the dots over their scale, last measurement
+	float m_aspect_x, m_aspect_y;
+
+	// a prediction was made and not yet checked against a measurement
+	bool m_pending;
+	int m_predictions;
+	int m_hits;
+};
+
+#endif	//MOTION_PREDICTOR_H
@@ -0,0 +1,224 @@
+#include "parallel_blob_detector.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+	// Threshold and blobs of a range of levels
+	class ThresholdLevels : public cv::ParallelLoopBody
+	{
+	public:
+		ThresholdLevels(const cv::SimpleBlobDetector::Params &params, const cv::Mat &gray,
+			const double *thresh, cv::Mat *binary, std::vector<ParallelBlobDetector::Center> *centers) :
+			m_params(params), m_gray(gray), m_thresh(thresh), m_binary(binary), m_centers(centers) {}
+
+		virtual void operator()(const cv::Range &range) const
+		{
+			for (int k = range.start; k < range.end; k++)
+			{
+				cv::threshold(m_gray, m_binary[k], m_thresh[k], 255, cv::THRESH_BINARY);
+				ParallelBlobDetector::findBlobs(m_params, m_binary[k], m_centers[k]);
+			}
+		}
+
+	private:
+		const cv::SimpleBlobDetector::Params &m_params;
+		const cv::Mat &m_gray;
+		const double *m_thresh;
+		cv::Mat *m_binary;
+		std::vector<ParallelBlobDetector::Center> *m_centers;
+	};
+}
+
+ParallelBlobDetector::ParallelBlobDetector(const cv::SimpleBlobDetector::Params &_params) :
+	params(_params)
+{
+}
+
+cv::Ptr<ParallelBlobDetector> ParallelBlobDetector::create(const cv::SimpleBlobDetector::Params &params)
+{
+	return cv::makePtr<ParallelBlobDetector>(params);
+}
+
+void ParallelBlobDetector::findBlobs(const cv::SimpleBlobDetector::Params &params,
+									 const cv::Mat &binary, std::vector<Center> &centers)
+{
+	centers.clear();
+
+	// findContours overwrites its input (OpenCV < 3.2), the colour test
+	// below reads the binarized image
+	std::vector<std::vector<cv::Point> > contours;
+	cv::Mat tmp_binary = binary.clone();
+	cv::findContours(tmp_binary, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+
+	for (size_t i = 0; i < contours.size(); i++)
+	{
+		Center center;
+		center.confidence = 1;
+		cv::Moments moms = cv::moments(cv::Mat(contours[i]));
+		if (params.filterByArea)
+		{
+			double area = moms.m00;
+			if (area < params.minArea || area >= params.maxArea)
+				continue;
+		}
+
+		if (params.filterByCircularity)
+		{
+			double area = moms.m00;
+			double perimeter = cv::arcLength(cv::Mat(contours[i]), true);
+			double ratio = 4 * CV_PI * area / (perimeter * perimeter);
+			if (ratio < params.minCircularity || ratio >= params.maxCircularity)
+				continue;
+		}
+
+		if (params.filterByInertia)
+		{
+			double denominator = std::sqrt(std::pow(2 * moms.mu11, 2) + std::pow(moms.mu20 - moms.mu02, 2));
+			const double eps = 1e-2;
+			double ratio;
+			if (denominator > eps)
+			{
+				double cosmin = (moms.mu20 - moms.mu02) / denominator;
+				double sinmin = 2 * moms.mu11 / denominator;
+				double cosmax = -cosmin;
+				double sinmax = -sinmin;
+
+				double imin = 0.5 * (moms.mu20 + moms.mu02) - 0.5 * (moms.mu20 - moms.mu02) * cosmin - moms.mu11 * sinmin;
+				double imax = 0.5 * (moms.mu20 + moms.mu02) - 0.5 * (moms.mu20 - moms.mu02) * cosmax - moms.mu11 * sinmax;
+				ratio = imin / imax;
+			}
+			else
+			{
+				ratio = 1;
+			}
+
+			if (ratio < params.minInertiaRatio || ratio >= params.maxInertiaRatio)
+				continue;
+
+			center.confidence = ratio * ratio;
+		}
+
+		if (params.filterByConvexity)
+		{
+			std::vector<cv::Point> hull;
+			cv::convexHull(cv::Mat(contours[i]), hull);
+			double area = cv::contourArea(cv::Mat(contours[i]));
+			double hullArea = cv::contourArea(cv::Mat(hull));
+			if (std::fabs(hullArea) < DBL_EPSILON)
+				continue;
+			double ratio = area / hullArea;
+			if (ratio < params.minConvexity || ratio >= params.maxConvexity)
+				continue;
+		}
+
+		if (moms.m00 == 0.0)
+			continue;
+		center.location = cv::Point2d(moms.m10 / moms.m00, moms.m01 / moms.m00);
+
+		if (params.filterByColor)
+		{
+			if (binary.at<uchar>(cvRound(center.location.y), cvRound(center.location.x)) != params.blobColor)
+				continue;
+		}
+
+		// radius: median distance to the contour
+		{
+			std::vector<double> dists;
+			for (size_t pointIdx = 0; pointIdx < contours[i].size(); pointIdx++)
+			{
+				cv::Point2d pt = contours[i][pointIdx];
+				dists.push_back(cv::norm(center.location - pt));
+			}
+			std::sort(dists.begin(), dists.end());
+			center.radius = (dists[(dists.size() - 1) / 2] + dists[dists.size() / 2]) / 2.;
+		}
+
+		centers.push_back(center);
+	}
+}
+
+void ParallelBlobDetector::detect(cv::InputArray _image, std::vector<cv::KeyPoint> &keypoints,
+								  cv::InputArray mask)
+{
+	keypoints.clear();
+
+	cv::Mat image = _image.getMat(), gray;
+	if (image.channels() == 3)
+		cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+	else
+		gray = image;
+	CV_Assert(gray.type() == CV_8UC1);
+
+	// same levels as the serial loop, with its floating point steps
+	level_thresh.clear();
+	for (double thresh = params.minThreshold; thresh < params.maxThreshold; thresh += params.thresholdStep)
+		level_thresh.push_back(thresh);
+	const int n_levels = (int)level_thresh.size();
+	if (n_levels == 0)
+		return;
+
+	if ((int)level_binary.size() < n_levels)
+	{
+		level_binary.resize(n_levels);
+		level_centers.resize(n_levels);
+	}
+
+	cv::parallel_for_(cv::Range(0, n_levels),
+		ThresholdLevels(params, gray, &level_thresh[0], &level_binary[0], &level_centers[0]), n_levels);
+
+	// Group the blobs of the levels in threshold order
+	groups.clear();
+	for (int k = 0; k < n_levels; k++)
+	{
+		const std::vector<Center> &curCenters = level_centers[k];
+		size_t n_groups = groups.size();
+		for (size_t i = 0; i < curCenters.size(); i++)
+		{
+			bool isNew = true;
+			for (size_t j = 0; j < n_groups; j++)
+			{
+				const Center &mid = groups[j][groups[j].size() / 2];
+				double dist = cv::norm(mid.location - curCenters[i].location);
+				isNew = dist >= params.minDistBetweenBlobs && dist >= mid.radius && dist >= curCenters[i].radius;
+				if (!isNew)
+				{
+					// keep the group sorted by radius
+					std::vector<Center> &group = groups[j];
+					group.push_back(curCenters[i]);
+					size_t m = group.size() - 1;
+					while (m > 0 && curCenters[i].radius < group[m - 1].radius)
+					{
+						group[m] = group[m - 1];
+						m--;
+					}
+					group[m] = curCenters[i];
+					break;
+				}
+			}
+			// new groups are only matched from the next level on
+			if (isNew)
+				groups.push_back(std::vector<Center>(1, curCenters[i]));
+		}
+	}
+
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		if (groups[i].size() < params.minRepeatability)
+			continue;
+		cv::Point2d sumPoint(0, 0);
+		double normalizer = 0;
+		for (size_t j = 0; j < groups[i].size(); j++)
+		{
+			sumPoint += groups[i][j].confidence * groups[i][j].location;
+			normalizer += groups[i][j].confidence;
+		}
+		sumPoint *= (1. / normalizer);
+		cv::KeyPoint kpt(sumPoint, (float)(groups[i][groups[i].size() / 2].radius) * 2.0f);
+		keypoints.push_back(kpt);
+	}
+
+	if (!mask.empty())
+		cv::KeyPointsFilter::runByPixelsMask(keypoints, mask.getMat());
+}
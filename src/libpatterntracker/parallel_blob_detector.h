@@ -0,0 +1,62 @@
+/*
+	ParallelBlobDetector class
+
+	cv::SimpleBlobDetector with its threshold levels processed in parallel.
+
+	Each level (binarization, contours and filters) is independent, so the
+	levels run concurrently with cv::parallel_for_, one result slot per
+	level. The blobs of the levels are then grouped serially in threshold
+	order exactly as SimpleBlobDetector does, so the keypoints are the
+	same as its, whatever the number of threads.
+*/
+
+
+#ifndef PARALLEL_BLOB_DETECTOR_H
+#define PARALLEL_BLOB_DETECTOR_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+#include <vector>
+
+class ParallelBlobDetector : public cv::FeatureDetector
+{
+public:
+	explicit ParallelBlobDetector(const cv::SimpleBlobDetector::Params &params
+		= cv::SimpleBlobDetector::Params());
+
+	static cv::Ptr<ParallelBlobDetector> create(const cv::SimpleBlobDetector::Params &params
+		= cv::SimpleBlobDetector::Params());
+
+	inline void setParams(const cv::SimpleBlobDetector::Params &_params) { params = _params; }
+
+	using cv::FeatureDetector::detect;
+
+	virtual void detect(cv::InputArray image, std::vector<cv::KeyPoint> &keypoints,
+		cv::InputArray mask = cv::noArray());
+
+	// Blob found at one threshold level
+	struct Center
+	{
+		cv::Point2d location;
+		double radius;
+		double confidence;
+	};
+
+	// Blobs of 'binary', the image thresholded at one level, filtered as
+	// by SimpleBlobDetector
+	static void findBlobs(const cv::SimpleBlobDetector::Params &params,
+		const cv::Mat &binary, std::vector<Center> &centers);
+
+private:
+	cv::SimpleBlobDetector::Params params;
+
+	// Threshold, binarized image and blobs of each level
+	std::vector<double> level_thresh;
+	std::vector<cv::Mat> level_binary;
+	std::vector<std::vector<Center> > level_centers;
+
+	// Blobs grouped across levels, by increasing radius
+	std::vector<std::vector<Center> > groups;
+};
+
+#endif	//PARALLEL_BLOB_DETECTOR_H
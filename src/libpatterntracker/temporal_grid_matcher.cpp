@@ -0,0 +1,119 @@
+#include "temporal_grid_matcher.h"
+#include <opencv2/calib3d.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+TemporalGridMatcher::TemporalGridMatcher(float gate, float ambiguity) :
+	m_gate(gate), m_ambiguity(ambiguity), m_spacing(0),
+	m_attempts(0), m_matches(0)
+{
+}
+
+void TemporalGridMatcher::reset()
+{
+	m_prev.clear();
+	m_slots.clear();
+	m_spacing = 0;
+}
+
+void TemporalGridMatcher::predict(const std::vector<cv::Point2f> &dots, const cv::Point2f &motion)
+{
+	reset();
+	if (dots.size() < 4)
+		return;
+
+	float min_d2 = FLT_MAX;
+	for (size_t i = 0; i < dots.size(); i++)
+		for (size_t j = i + 1; j < dots.size(); j++)
+		{
+			cv::Point2f d = dots[i] - dots[j];
+			min_d2 = std::min(min_d2, d.dot(d));
+		}
+	if (!(min_d2 > 0))
+		return;
+
+	m_spacing = std::sqrt(min_d2);
+	m_prev = dots;
+	m_slots.resize(dots.size());
+	for (size_t i = 0; i < dots.size(); i++)
+		m_slots[i] = dots[i] + motion;
+}
+
+bool TemporalGridMatcher::match(const std::vector<cv::Point2f> &points, const cv::Point2f &origin,
+								std::vector<cv::Point2f> &centers, std::vector<int> &indices,
+								const std::vector<uchar> *mask)
+{
+	centers.clear();
+	indices.clear();
+	if (m_slots.empty() || points.size() < m_slots.size())
+		return false;
+	m_attempts++;
+
+	// Points left in sorted by x: the keypoints near a slot are a range
+	m_order.clear();
+	for (size_t i = 0; i < points.size(); i++)
+		if (!mask || !(*mask)[i])
+			m_order.push_back((int)i);
+	std::sort(m_order.begin(), m_order.end(),
+		[&points](int a, int b) { return points[a].x < points[b].x; });
+	m_xs.resize(m_order.size());
+	for (size_t k = 0; k < m_order.size(); k++)
+		m_xs[k] = points[m_order[k]].x;
+
+	// Nearest and second nearest keypoint of each slot within a grid
+	// spacing (farther ones do not make it ambiguous)
+	const float gate = m_gate * m_spacing;
+	m_taken.assign(points.size(), 0);
+	for (size_t s = 0; s < m_slots.size(); s++)
+	{
+		const cv::Point2f pt = m_slots[s] - origin;
+		int best = -1;
+		float d1 = m_spacing, d2 = m_spacing;
+		for (size_t k = std::lower_bound(m_xs.begin(), m_xs.end(), pt.x - m_spacing) - m_xs.begin();
+			k < m_xs.size() && m_xs[k] <= pt.x + m_spacing; k++)
+		{
+			const float d = (float)cv::norm(points[m_order[k]] - pt);
+			if (d < d1)
+			{
+				d2 = d1;
+				d1 = d;
+				best = m_order[k];
+			}
+			else if (d < d2)
+				d2 = d;
+		}
+		if (best < 0 || d1 > gate || d1 > m_ambiguity * d2 || m_taken[best])
+		{
+			centers.clear();
+			indices.clear();
+			return false;
+		}
+		m_taken[best] = 1;
+		centers.push_back(points[best]);
+		indices.push_back(best);
+	}
+
+	// The grid moves by a homography between two frames, a keypoint
+	// taken off its dot (clutter, merged blob) does not follow it
+	m_dst.resize(centers.size());
+	for (size_t i = 0; i < centers.size(); i++)
+		m_dst[i] = centers[i] + origin;
+	cv::Mat H = cv::findHomography(m_prev, m_dst, 0);
+	bool valid = !H.empty();
+	if (valid)
+	{
+		cv::perspectiveTransform(m_prev, m_proj, H);
+		const float tolerance = std::max(1.5f, 0.15f * m_spacing);
+		for (size_t i = 0; i < m_dst.size() && valid; i++)
+			valid = cv::norm(m_proj[i] - m_dst[i]) <= tolerance;
+	}
+	if (!valid)
+	{
+		centers.clear();
+		indices.clear();
+		return false;
+	}
+	m_matches++;
+	return true;
+}
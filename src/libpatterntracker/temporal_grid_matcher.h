@@ -0,0 +1,68 @@
+/*
+	TemporalGridMatcher class
+
+	Finds the dot grid of the last frame again among the blob keypoints of
+	the current one, without the cluster finder: each slot of the grid
+	takes the keypoint nearest to its predicted position. The match is
+	only accepted when every slot has a keypoint within a gate, clearly
+	nearer than any other, no keypoint is taken twice and the grid moved
+	by a homography. Otherwise the caller runs the full finder.
+*/
+
+
+#ifndef TEMPORAL_GRID_MATCHER_H
+#define TEMPORAL_GRID_MATCHER_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+class TemporalGridMatcher
+{
+public:
+	// 'gate': largest distance of a keypoint to its slot, as a fraction of
+	// the distance between the closest two dots of the grid.
+	// 'ambiguity': the nearest keypoint of a slot must be closer than
+	// 'ambiguity' times the second nearest
+	TemporalGridMatcher(float gate = 0.4f, float ambiguity = 0.5f);
+
+	// Forget the grid (lost)
+	void reset();
+
+	inline bool initialised() const { return !m_slots.empty(); }
+
+	// Grid 'dots' of the last frame (slot order), predicted to move by
+	// 'motion' in the current one. Less than 4 dots resets the matcher
+	void predict(const std::vector<cv::Point2f> &dots, const cv::Point2f &motion);
+
+	// Assign 'points', keypoints of an image whose origin is 'origin' in
+	// the frame, to the slots. Points with (*mask)[i] != 0 are left out.
+	// 'centers' get the keypoint of each slot, 'indices' its index in
+	// 'points'. False (both empty) if the match is incomplete or ambiguous
+	bool match(const std::vector<cv::Point2f> &points, const cv::Point2f &origin,
+		std::vector<cv::Point2f> &centers, std::vector<int> &indices,
+		const std::vector<uchar> *mask = NULL);
+
+	// Fraction of the matches tried that were accepted, 0 if none was tried
+	inline float matchRate() const { return m_attempts ? (float)m_matches / m_attempts : 0.f; }
+
+private:
+	float m_gate;
+	float m_ambiguity;
+
+	// grid of the last frame, its slots in the current one and the
+	// distance between its closest two dots
+	std::vector<cv::Point2f> m_prev, m_slots;
+	float m_spacing;
+
+	// scratch: points left in by x, their x, points taken, matched grid
+	// in the frame and the grid projected onto it
+	std::vector<int> m_order;
+	std::vector<float> m_xs;
+	std::vector<unsigned char> m_taken;
+	std::vector<cv::Point2f> m_dst, m_proj;
+
+	int m_attempts;
+	int m_matches;
+};
+
+#endif	//TEMPORAL_GRID_MATCHER_H
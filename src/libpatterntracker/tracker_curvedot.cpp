@@ -1,5 +1,17 @@
 #include "tracker_curvedot.h"
 
+namespace
+{
+	// The chess detector blurs (5x5 box) the gray image itself,
+	// fused into the response kernel
+	ChessDetector::Params chessParams()
+	{
+		ChessDetector::Params params;
+		params.blurInput = true;
+		return params;
+	}
+}
+
 TrackerCurvedot::TrackerCurvedot(cv::Size _pattern_size,
 							 cv::Size _roi_size,
                              cv::SimpleBlobDetector::Params params,
@@ -10,9 +22,12 @@ TrackerCurvedot::TrackerCurvedot(cv::Size _pattern_size,
 	SymmCirclesGridClusterFinder(false, false),
 	AsymmCirclesGridClusterFinder(true, true),
 	curr_state (UNKNOWN),
+	m_chess_detector (chessParams()),
 	m_chess_found (false),
 	m_thresh_dot_chess(10),
-	m_thresh_chess (100)
+	m_thresh_chess (100),
+	m_chess_frames_since_sweep (0),
+	m_chess_sweep_interval (30)
 {
 	asym_pattern_size = cv::Size(1, pattern_size.height + (pattern_size.height-1));
 	sym_pattern_size = pattern_size;
@@ -73,7 +88,7 @@ TrackerCurvedot::TrackerCurvedot(cv::Size _pattern_size,
 bool TrackerCurvedot::track(const cv::Mat &cur_image)
 {
 	cv::Mat cur_gray;
-	cv::cvtColor(cur_image, cur_gray, cv::COLOR_BGR2GRAY);
+	ScaledGray(cur_image, cur_gray);
 
 	bool found = DetectPattern(cur_gray, curr_sym_dots, curr_asym_dots, curr_chess_dots);
 	asym_homography = sym_homography = cv::Mat();
@@ -128,6 +143,10 @@ bool TrackerCurvedot::track(const cv::Mat &cur_image)
 		{
 			isSymTracking = false;
 			isAsymTracking = false;
+			m_chess_window = cv::Rect();
+			bhasLastLocation = false;
+			motion_predictor.reset();
+			UpdateBlobArea(0);
 			return false;
 		}
 	}
@@ -220,11 +239,14 @@ bool TrackerCurvedot::track(const cv::Mat &cur_image)
 	else if (!curr_asym_dots.empty())
 		UpdateLastLocation(curr_asym_dots);
 
+	// Blob area window from the apparent dot spacing
+	UpdateBlobArea(MinDotSpacing(!curr_sym_dots.empty() ? curr_sym_dots : curr_asym_dots));
+
 	// Update adaptive threshold for marker detection
 	if (isSymTracking && isAsymTracking)
 	{
-		m_thresh_dot_chess = 10;
-		m_thresh_chess = cur_image.cols / 4;
+		m_thresh_dot_chess = 10 / img_scale;
+		m_thresh_chess = cur_gray.cols / 4;
 	}
 	else
 	{
@@ -241,10 +263,42 @@ bool TrackerCurvedot::track(const cv::Mat &cur_image)
 		m_thresh_chess = end_dots_dist / 2;
 	}
 
+	UpdateChessWindow(cur_gray.size());
+
+	// Output at full resolution
+	RefineDots(cur_image, curr_sym_dots, img_sym_dots);
+	RefineDots(cur_image, curr_asym_dots, img_asym_dots);
+	img_chess_dots = curr_chess_dots;
+	if (img_scale > 1)
+	{
+		ToImageCoords(img_chess_dots, 0.5f);
+		m_chess_detector.refine(cur_image, (float)img_scale, img_chess_dots);
+	}
 
 	return true;
 }
 
+void TrackerCurvedot::SetImageScale(int scale)
+{
+	if (std::max(scale, 1) == img_scale)
+		return;
+	TrackerKeydot::SetImageScale(scale);
+
+	binitSymTracker = false;
+	binitAsymTracker = false;
+	isSymTracking = false;
+	isAsymTracking = false;
+	curr_state = UNKNOWN;
+	curr_sym_dots.clear();
+	curr_asym_dots.clear();
+	curr_chess_dots.clear();
+	img_sym_dots.clear();
+	img_asym_dots.clear();
+	img_chess_dots.clear();
+	m_chess_window = cv::Rect();
+	m_thresh_dot_chess = 10 / img_scale;
+}
+
 bool TrackerCurvedot::DetectPattern(const cv::Mat& _img_gray,
 									std::vector<cv::Point2f>& _symm_dots,
 									std::vector<cv::Point2f>& _asymm_dots,
@@ -254,67 +308,113 @@ bool TrackerCurvedot::DetectPattern(const cv::Mat& _img_gray,
 
 	// Detect chess vertice first which should be excluded in FindDots
 	std::vector<cv::Point2f> chess_pts, all_chess_pts;
-	cv::Mat img_burr;
-	cv::blur(_img_gray, img_burr, cv::Size(5, 5));
 
-	m_chess_found = m_chess_detector.detect(img_burr, chess_pts, all_chess_pts, m_thresh_chess);//m_thresh_chess
+	// Search around the previous location first, fall back to the whole frame
+	// if nothing is found there or a periodic full search is due
+	m_chess_found = false;
+	const cv::Rect window = m_chess_window & cv::Rect(0, 0, _img_gray.cols, _img_gray.rows);
+	if (!window.empty() && ++m_chess_frames_since_sweep < m_chess_sweep_interval)
+		m_chess_found = m_chess_detector.detect(_img_gray, window, chess_pts, all_chess_pts, m_thresh_chess);
+	if (!m_chess_found)
+	{
+		m_chess_found = m_chess_detector.detect(_img_gray, chess_pts, all_chess_pts, m_thresh_chess);//m_thresh_chess
+		m_chess_frames_since_sweep = 0;
+	}
 	_chess_pts = chess_pts;
 
-	if (!chess_pts.empty())
-	{
-		found = FindDots(_img_gray, sym_pattern_size, asym_pattern_size,
-			_symm_dots, _asymm_dots,
-			blob_detector, chess_pts);
-	} 
+	// Dots: ROI around the last location, wider ROI then full frame if the
+	// marker was found last frame, otherwise full frame then ROI
+	// (see TrackerKeydot::DetectPattern). 'curr_state' is still the state
+	// of the last frame here: a ROI result missing one of the parts found
+	// then is not accepted, the window is widened instead.
+	static const int roi_first[] = {DETECT_ROI, DETECT_ROI_WIDE, DETECT_FULL};
+	static const int full_first[] = {DETECT_FULL, DETECT_ROI};
+	const int *levels = bhasLastLocation ? roi_first : full_first;
+	const int n_levels = bhasLastLocation ? 3 : 2;
+	const bool had_sym = bhasLastLocation && (curr_state & MID_CIR);
+	const bool had_asym = bhasLastLocation && (curr_state & (TOP_CIR | BOT_CIR));
+	if (bhasLastLocation)
+		motion_predictor.predict();
+	const cv::Point2f motion = motion_predictor.initialised() ?
+		motion_predictor.velocity() : cv::Point2f(0, 0);
+	if (had_sym && curr_sym_dots.size() == sym_model_dots.size())
+		sym_grid_matcher.predict(curr_sym_dots, motion);
 	else
-	{
-		found = FindDots(_img_gray, sym_pattern_size, asym_pattern_size,
-			_symm_dots, _asymm_dots,
-			blob_detector);
+		sym_grid_matcher.reset();
+	if (had_asym && curr_asym_dots.size() == asym_model_dots.size())
+		asym_grid_matcher.predict(curr_asym_dots, motion);
+	else
+		asym_grid_matcher.reset();
+
+	// Every dot of the parts found last frame around its predicted position
+	// first. Dots shared by both parts get the same window, so they stay
+	// identical (orientation checks in track())
+	detect_level = DETECT_NONE;
+	int r = 0;
+	if (had_sym)
+		r = DotWindowRadius(curr_sym_dots);
+	if (had_asym)
+		r = r ? std::min(r, DotWindowRadius(curr_asym_dots)) : DotWindowRadius(curr_asym_dots);
+	if ((had_sym || had_asym) &&
+		(!had_sym || (curr_sym_dots.size() == sym_model_dots.size() &&
+			RedetectDots(_img_gray, curr_sym_dots, local_sym_dots, r))) &&
+		(!had_asym || (curr_asym_dots.size() == asym_model_dots.size() &&
+			RedetectDots(_img_gray, curr_asym_dots, _asymm_dots, r))))
+	{
+		if (had_sym)
+			_symm_dots = local_sym_dots;
+		else
+			_symm_dots.clear();
+		if (!had_asym)
+			_asymm_dots.clear();
+		detect_level = DETECT_LOCAL;
+		return true;
 	}
-	
-	// Two attempts
 
-// 	if (!found)
-// 	{
-// 		// crop a roi for 2nd attempts
-// 		cv::Rect rect = cv::Rect((int)last_valid_location.x, (int)last_valid_location.y, 
-// 			2*roi_hw, 2*roi_hh);
-// 		rect.x = rect.x < 0? 0 : rect.x;
-// 		rect.y = rect.y < 0? 0 : rect.y;
-// 		rect.width = (rect.x+rect.width) > (_img_gray.cols - 1) 
-// 			? (_img_gray.cols-rect.x-1) : rect.width;
-// 		rect.height = (rect.y+rect.height) > (_img_gray.rows - 1)
-// 			? (_img_gray.rows-rect.y-1) : rect.height;
-// 
-// 		//cv::rectangle(cur_image, rect, CV_RGB(250,250, 0));
-// 		cv::Mat roi = _img_gray(rect);
-// 		found = FindDots(roi, sym_pattern_size, asym_pattern_size, _symm_dots, _asymm_dots,
-// 			roi_blob_detector);
-// 		if (found)
-// 		{
-// 			for (unsigned int i = 0; i < _symm_dots.size(); i++)
-// 			{
-// 				_symm_dots[i].x = _symm_dots[i].x + last_valid_location.x;
-// 				_symm_dots[i].y = _symm_dots[i].y + last_valid_location.y;
-// 				std::cout << _symm_dots[i] << ", ";
-// 			}
-// 			for (unsigned int i = 0; i < _asymm_dots.size(); i++)
-// 			{
-// 				_asymm_dots[i].x = _asymm_dots[i].x + last_valid_location.x;
-// 				_asymm_dots[i].y = _asymm_dots[i].y + last_valid_location.y;
-// 			}
-// 			std::cout << std::endl;
-// 			std::cout << "2nd Try found: " << _symm_dots.size() << ", " << _asymm_dots.size() << std::endl;
-// 		}
-// 	}
+	found = false;
+	for (int i = 0; i < n_levels && !found; i++)
+	{
+		if (levels[i] == DETECT_FULL)
+		{
+			found = FindDots(_img_gray, sym_pattern_size, asym_pattern_size,
+				_symm_dots, _asymm_dots,
+				blob_detector, chess_pts);
+		}
+		else
+		{
+			cv::Rect rect = DetectWindow(_img_gray.size(), levels[i]);
+			if (rect.empty())
+				continue;
+			const cv::Point2f offset((float)rect.x, (float)rect.y);
+			std::vector<cv::Point2f> roi_chess_pts(chess_pts.size());
+			for (size_t j = 0; j < chess_pts.size(); j++)
+				roi_chess_pts[j] = chess_pts[j] - offset;
+
+			cv::Mat roi = _img_gray(rect);
+			found = FindDots(roi, sym_pattern_size, asym_pattern_size,
+				_symm_dots, _asymm_dots,
+				roi_blob_detector, roi_chess_pts, offset);
+			if (found && ((had_sym && _symm_dots.empty()) || (had_asym && _asymm_dots.empty())))
+				found = false;
+			if (found)
+			{
+				for (size_t j = 0; j < _symm_dots.size(); j++)
+					_symm_dots[j] += offset;
+				for (size_t j = 0; j < _asymm_dots.size(); j++)
+					_asymm_dots[j] += offset;
+			}
+		}
+		if (found)
+			detect_level = levels[i];
+	}
 	return found;
 }
 
 bool TrackerCurvedot::FindDots(cv::InputArray _image, cv::Size sym_patternSize, cv::Size asym_patternSize,
 							   cv::OutputArray _sym_centers, cv::OutputArray _asym_centers, 
 							   const cv::Ptr<cv::FeatureDetector> &blobDetector,
-							   const std::vector<cv::Point2f> &chess_pts)
+							   const std::vector<cv::Point2f> &chess_pts,
+							   const cv::Point2f &_origin)
 {
 	cv::Mat image = _image.getMat();
 	std::vector<cv::Point2f> sym_centers, asym_centers;
@@ -355,14 +455,29 @@ bool TrackerCurvedot::FindDots(cv::InputArray _image, cv::Size sym_patternSize,
 // 	}
 
 
-	AsymmCirclesGridClusterFinder.findGrid(points, asym_patternSize, asym_centers);
-	if (asym_centers.empty())
-		SymmCirclesGridClusterFinder.findGrid(points, sym_patternSize, sym_centers);
-	else
+	// The parts of the last frame at their predicted positions first, the
+	// finders (both querying the same index of the points) otherwise
+	m_candidates.build(points);
+	std::vector<int> sym_ids, asym_ids;
+	if (!asym_grid_matcher.match(points, _origin, asym_centers, asym_ids))
 	{
-		std::vector<uchar> ex_mask = AsymmCirclesGridClusterFinder.getAsmSegMask();
-		// If asymmetric grid detected, need to exclude short seg
-		SymmCirclesGridClusterFinder.findGridwithExMask(points, sym_patternSize, ex_mask, sym_centers);
+		AsymmCirclesGridClusterFinder.findGrid(m_candidates, asym_patternSize, asym_centers);
+		asym_ids = AsymmCirclesGridClusterFinder.getCenterIndices();
+	}
+
+	// If asymmetric grid detected, need to exclude short seg (odd dots)
+	std::vector<uchar> ex_mask;
+	if (!asym_ids.empty())
+	{
+		ex_mask.assign(points.size(), 0);
+		for (size_t i = 1; i < asym_ids.size(); i += 2)
+			ex_mask[asym_ids[i]] = 1;
+	}
+	const std::vector<uchar> *sym_mask = ex_mask.empty() ? NULL : &ex_mask;
+	if (!sym_grid_matcher.match(points, _origin, sym_centers, sym_ids, sym_mask))
+	{
+		SymmCirclesGridClusterFinder.findGrid(m_candidates, sym_patternSize, sym_centers, sym_mask);
+		sym_ids = SymmCirclesGridClusterFinder.getCenterIndices();
 	}
 
 	//////////////////////////////////////////////////////////////////////////
@@ -583,15 +698,16 @@ void TrackerCurvedot::drawKeydots(cv::InputOutputArray _image)
 	if ((curr_state & MID_CIR) || (curr_state & (MID_CIR & TOP_CIR)) || (curr_state & (MID_CIR & BOT_CIR)))
 	{
 		cv::perspectiveTransform(sym_corner_pts, curr_sym_corners, sym_homography);
+		ToImageCoords(curr_sym_corners);
 
 
-		for (unsigned int i = 0; i < curr_sym_dots.size(); i++)
+		for (unsigned int i = 0; i < img_sym_dots.size(); i++)
 		{
-			cv::circle(image, curr_sym_dots[i], 4, sym_dot_colors[i], 1, CV_AA);
-			cv::line(image, cv::Point2f(curr_sym_dots[i].x-3, curr_sym_dots[i].y), 
-				cv::Point2f(curr_sym_dots[i].x+3, curr_sym_dots[i].y), sym_dot_colors[i]);
-			cv::line(image,cv::Point2f( curr_sym_dots[i].x, curr_sym_dots[i].y-3),
-				cv::Point2f(curr_sym_dots[i].x, curr_sym_dots[i].y+3), sym_dot_colors[i] );
+			cv::circle(image, img_sym_dots[i], 4, sym_dot_colors[i], 1, CV_AA);
+			cv::line(image, cv::Point2f(img_sym_dots[i].x-3, img_sym_dots[i].y), 
+				cv::Point2f(img_sym_dots[i].x+3, img_sym_dots[i].y), sym_dot_colors[i]);
+			cv::line(image,cv::Point2f( img_sym_dots[i].x, img_sym_dots[i].y-3),
+				cv::Point2f(img_sym_dots[i].x, img_sym_dots[i].y+3), sym_dot_colors[i] );
 		}
 // 		cv::circle(image, curr_sym_dots[0], 8, cv::Scalar(255, 10, 10), 2, CV_AA);
 
@@ -605,19 +721,20 @@ void TrackerCurvedot::drawKeydots(cv::InputOutputArray _image)
 		|| (curr_state & TOP_CIR) || (curr_state & BOT_CIR))
 	{
 		cv::perspectiveTransform(asym_corner_pts, curr_asym_corners, asym_homography);
+		ToImageCoords(curr_asym_corners);
 
 
-		for (unsigned int i = 0; i < curr_asym_dots.size(); i++)
+		for (unsigned int i = 0; i < img_asym_dots.size(); i++)
 		{
-			cv::circle(image, curr_asym_dots[i], 4, asym_dot_colors[i], 1, CV_AA);
-			cv::line(image, cv::Point2f(curr_asym_dots[i].x-3, curr_asym_dots[i].y), 
-				cv::Point2f(curr_asym_dots[i].x+3, curr_asym_dots[i].y), asym_dot_colors[i]);
-			cv::line(image,cv::Point2f( curr_asym_dots[i].x, curr_asym_dots[i].y-3),
-				cv::Point2f(curr_asym_dots[i].x, curr_asym_dots[i].y+3), asym_dot_colors[i] );
-			if (i < curr_asym_dots.size() - 2)
+			cv::circle(image, img_asym_dots[i], 4, asym_dot_colors[i], 1, CV_AA);
+			cv::line(image, cv::Point2f(img_asym_dots[i].x-3, img_asym_dots[i].y), 
+				cv::Point2f(img_asym_dots[i].x+3, img_asym_dots[i].y), asym_dot_colors[i]);
+			cv::line(image,cv::Point2f( img_asym_dots[i].x, img_asym_dots[i].y-3),
+				cv::Point2f(img_asym_dots[i].x, img_asym_dots[i].y+3), asym_dot_colors[i] );
+			if (i < img_asym_dots.size() - 2)
 			{
-				cv::line(image,cv::Point2f( curr_asym_dots[i].x, curr_asym_dots[i].y),
-					cv::Point2f(curr_asym_dots[i+1].x, curr_asym_dots[i+1].y), asym_dot_colors[i] );
+				cv::line(image,cv::Point2f( img_asym_dots[i].x, img_asym_dots[i].y),
+					cv::Point2f(img_asym_dots[i+1].x, img_asym_dots[i+1].y), asym_dot_colors[i] );
 			}
 		}
 
@@ -629,10 +746,10 @@ void TrackerCurvedot::drawKeydots(cv::InputOutputArray _image)
 // 		cv::circle(image, curr_asym_dots[0], 8, cv::Scalar(255, 0, 0), 2, CV_AA);
 	}
 	
-	if (!curr_chess_dots.empty())
+	if (!img_chess_dots.empty())
 	{
-		for (auto i = 0; i < curr_chess_dots.size(); i++)
-			cv::circle(image, curr_chess_dots[i], 2, cv::Scalar(0, 255, 255), 2, CV_AA);	
+		for (auto i = 0; i < img_chess_dots.size(); i++)
+			cv::circle(image, img_chess_dots[i], 2, cv::Scalar(0, 255, 255), 2, CV_AA);	
 
 // 		cv::Point pt1, pt2;
 // 		pt1.x = 10; pt1.y = (-m_chess_line[0] * pt1.x - m_chess_line[2])/m_chess_line[1];
@@ -665,20 +782,20 @@ std::vector<cv::Point2f> TrackerCurvedot::getP_img()
 	std::vector<cv::Point2f> out_pts;
 	if (((curr_state & TOP_CIR) || (curr_state & BOT_CIR)) && !(curr_state & MID_CIR))
 	{
-		out_pts = curr_asym_dots;
+		out_pts = img_asym_dots;
 	}
 	else if (((curr_state & TOP_CIR) || (curr_state & BOT_CIR)) && (curr_state & MID_CIR))
 	{
-		int num_sym_dot = curr_sym_dots.size();
-		int num_asym_dot = curr_asym_dots.size();
+		int num_sym_dot = img_sym_dots.size();
+		int num_asym_dot = img_asym_dots.size();
 		out_pts.reserve(num_sym_dot/2 + num_asym_dot);
-		out_pts.insert(out_pts.end(), curr_asym_dots.begin(), curr_asym_dots.end());
+		out_pts.insert(out_pts.end(), img_asym_dots.begin(), img_asym_dots.end());
 		if (curr_state & TOP_CIR)
 		{
 			for (int i = 0; i < num_sym_dot; i++)
 			{
 				if (i%2 != 0)
-					out_pts.push_back(curr_sym_dots[i]);
+					out_pts.push_back(img_sym_dots[i]);
 			}
 		}
 		else
@@ -686,12 +803,12 @@ std::vector<cv::Point2f> TrackerCurvedot::getP_img()
 			for (int i = 0; i < num_sym_dot; i++)
 			{
 				if (i%2 == 0)
-					out_pts.push_back(curr_sym_dots[i]);
+					out_pts.push_back(img_sym_dots[i]);
 			}
 		}
 	}
 	else if ((curr_state & MID_CIR))
-		out_pts = curr_sym_dots;
+		out_pts = img_sym_dots;
 		
 	return out_pts;
 }
@@ -699,7 +816,7 @@ std::vector<cv::Point2f> TrackerCurvedot::getP_img()
 cv::Vec3f TrackerCurvedot::get_chess_line()
 {
 	cv::Vec4f line_ps;
-	cv::fitLine(curr_chess_dots, line_ps, CV_DIST_L1, 0, 0.01, 0.01);
+	cv::fitLine(img_chess_dots, line_ps, CV_DIST_L1, 0, 0.01, 0.01);
 
 	// Convert point-slope form to general form
 	auto m = line_ps[1] / line_ps[0];
@@ -712,7 +829,34 @@ cv::Vec3f TrackerCurvedot::get_chess_line()
 
 std::vector<cv::Point2f> TrackerCurvedot::get_chess_pts()
 {
-	return curr_chess_dots;
+	return img_chess_dots;
+}
+
+void TrackerCurvedot::UpdateChessWindow(const cv::Size &img_size)
+{
+	std::vector<cv::Point2f> pts;
+	pts.reserve(curr_chess_dots.size() + curr_sym_dots.size() + curr_asym_dots.size());
+	pts.insert(pts.end(), curr_chess_dots.begin(), curr_chess_dots.end());
+	pts.insert(pts.end(), curr_sym_dots.begin(), curr_sym_dots.end());
+	pts.insert(pts.end(), curr_asym_dots.begin(), curr_asym_dots.end());
+
+	if (pts.empty())
+	{
+		m_chess_window = cv::Rect();
+		return;
+	}
+
+	// Margin for the motion to next frame, plus the ChESS border (7)
+	// and non-maximum suppression radius so edge features are kept
+	const int pad = std::max(m_thresh_chess / 2, 32) + 20;
+	// shifted by the predicted motion of the marker
+	const cv::Point2f motion = motion_predictor.initialised() ? motion_predictor.velocity() : cv::Point2f(0, 0);
+	cv::Rect box = cv::boundingRect(pts);
+	box.x += cvRound(motion.x) - pad;
+	box.y += cvRound(motion.y) - pad;
+	box.width += 2 * pad;
+	box.height += 2 * pad;
+	m_chess_window = box & cv::Rect(0, 0, img_size.width, img_size.height);
 }
 
 void TrackerCurvedot::calc_chess_orient(const float &slope, int &label_mid, int &label_out)
@@ -36,6 +36,8 @@ public:
 
     virtual bool track(const cv::Mat &cur_image);
 
+	virtual void SetImageScale(int scale);
+
     // --- Detection part ---
     bool DetectPattern(const cv::Mat& _img_gray, 
 		std::vector<cv::Point2f>& _symm_dots,
@@ -45,7 +47,8 @@ public:
     bool FindDots( cv::InputArray _image, cv::Size sym_patternSize, cv::Size asym_patternSize,
         cv::OutputArray _sym_centers, cv::OutputArray _asym_centers, 
 		const cv::Ptr<cv::FeatureDetector> &blobDetector,
-		const std::vector<cv::Point2f> &chess_pts = std::vector<cv::Point2f>());
+		const std::vector<cv::Point2f> &chess_pts = std::vector<cv::Point2f>(),
+		const cv::Point2f &_origin = cv::Point2f());
 
 	// --- Tracking part ---
 	void initSymTrack(cv::Mat& _pre_gray, std::vector<cv::Point2f> _prev_dots);
@@ -60,6 +63,13 @@ public:
 
 	inline bool ChessFound() { return m_chess_found; }
 
+	// Fraction of chess features agreeing with the majority orientation
+	// in the last chess detection (0 if none)
+	inline float ChessOrientConfidence() const { return m_chess_detector.OrientationConfidence(); }
+
+	// Orientation histogram of the last chess detection, bin 'ori + 4'
+	inline void ChessOrientHistogram(int hist[8]) const { m_chess_detector.OrientationHistogram(hist); }
+
 	// get points in image coordinate
 	std::vector<cv::Point2f> getP_img();
 
@@ -75,6 +85,11 @@ protected:
 
 	CirclesGridClusterFinder SymmCirclesGridClusterFinder;
 	CirclesGridClusterFinder AsymmCirclesGridClusterFinder;
+	// Dot candidates of the current FindDots, shared by the two finders
+	CandidateIndex m_candidates;
+	// Parts of the last frame looked for among the candidates first
+	TemporalGridMatcher sym_grid_matcher;
+	TemporalGridMatcher asym_grid_matcher;
 
     // --- Dection part ---
 	cv::Size asym_pattern_size;
@@ -94,6 +109,14 @@ protected:
 	// Chess dots
 	std::vector<cv::Point2f> curr_chess_dots;
 
+	// Dots and chess points at full resolution
+	std::vector<cv::Point2f> img_sym_dots;
+	std::vector<cv::Point2f> img_asym_dots;
+	std::vector<cv::Point2f> img_chess_dots;
+
+	// Symmetric dots re-detected around their last position
+	std::vector<cv::Point2f> local_sym_dots;
+
 	// Indicate which part(s) are tracked (TOP, TOP_MID, MID, BOT_MID, BOT)
 	int curr_state;
 
@@ -117,6 +140,18 @@ protected:
 	// Chess line in general form (A, B, C) (AX+BY+C=0)
 	cv::Vec3f m_chess_line;
 
+	// Window around the marker found in the previous frame,
+	// chess features are searched inside it only.
+	// Empty if the marker was lost (full frame search).
+	cv::Rect m_chess_window;
+
+	// Frames since the last full frame chess search
+	int m_chess_frames_since_sweep;
+
+	// A full frame chess search is forced every 'm_chess_sweep_interval' frames
+	// so that features outside the window are picked up again
+	int m_chess_sweep_interval;
+
     // --- Tracking part ---
 	bool binitSymTracker;
 	bool binitAsymTracker;
@@ -144,6 +179,9 @@ private:
 	// Input slope of line, return orientation label (-4 ~ 3)
 	void calc_chess_orient (const float &slope, int &label_mid, int &label_out);
 
+	// Set 'm_chess_window' around current dots and chess points
+	void UpdateChessWindow(const cv::Size &img_size);
+
 
 };
 
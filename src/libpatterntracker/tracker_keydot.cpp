@@ -1,15 +1,79 @@
 #include "tracker_keydot.h"
+#include "parallel_blob_detector.h"
+#include <cfloat>
+
+namespace
+{
+	// Minimum grey level difference between a dot and its surroundings
+	const int MIN_DOT_CONTRAST = 20;
+
+	// Move 'pt' to the centroid of the dot pixels (darker than the mid
+	// level, brighter with 'bright') of the window of half size 'r' around
+	// it, twice so that the second window is centred on the dot. False if
+	// the window leaves the image, has no contrast or the dot pixels run
+	// out of it
+	bool dotCentroid(const cv::Mat &gray, int r, bool bright, cv::Point2f &pt)
+	{
+		for (int iter = 0; iter < 2; iter++)
+		{
+			const int cx = cvRound(pt.x), cy = cvRound(pt.y);
+			if (cx - r < 0 || cy - r < 0 || cx + r >= gray.cols || cy + r >= gray.rows)
+				return false;
+
+			int lo = 255, hi = 0;
+			for (int y = cy - r; y <= cy + r; y++)
+			{
+				const uchar *row = gray.ptr<uchar>(y);
+				for (int x = cx - r; x <= cx + r; x++)
+				{
+					lo = std::min(lo, (int)row[x]);
+					hi = std::max(hi, (int)row[x]);
+				}
+			}
+			if (hi - lo < MIN_DOT_CONTRAST)
+				return false;
+
+			const int thresh = (lo + hi + 1) / 2;
+			int sw = 0, sx = 0, sy = 0, border_dot = 0;
+			for (int y = -r; y <= r; y++)
+			{
+				const uchar *row = gray.ptr<uchar>(cy + y) + cx;
+				const bool edge_row = y == -r || y == r;
+				for (int x = -r; x <= r; x++)
+				{
+					const int w = bright ? row[x] - thresh : thresh - row[x];
+					if (w > 0)
+					{
+						sw += w;
+						sx += w * x;
+						sy += w * y;
+						border_dot += edge_row || x == -r || x == r;
+					}
+				}
+			}
+			// a quarter of the window border (8r pixels) dot: not a lone dot
+			if (border_dot > 2 * r)
+				return false;
+
+			pt = cv::Point2f(cx + (float)sx / sw, cy + (float)sy / sw);
+		}
+		return true;
+	}
+}
 
 TrackerKeydot::TrackerKeydot(cv::Size _pattern_size, cv::Size _roi_size,
 							 cv::SimpleBlobDetector::Params params,
 							 cv::SimpleBlobDetector::Params params_roi) :
 	last_valid_location(cv::Point2f(200, 200)),
+	bhasLastLocation(false), detect_level(DETECT_NONE), blob_spacing(0), img_scale(1),
 	pattern_size(_pattern_size), square_size (1.0f),
 	roi_hw(_roi_size.width/2), roi_hh(_roi_size.height/2),
-	binitTracker(false), bisTracking(false)
+	binitTracker(false), bisTracking(false),
+	blob_params(params), roi_blob_params(params_roi)
 {
-	blob_detector = cv::SimpleBlobDetector::create(params);
-	roi_blob_detector = cv::SimpleBlobDetector::create(params_roi);
+	blob_detector = ParallelBlobDetector::create(blob_params);
+	roi_blob_detector = ParallelBlobDetector::create(roi_blob_params);
+	ApplyBlobArea();
 }
 
 TrackerKeydot::TrackerKeydot(cv::Size _pattern_size, int flag,
@@ -17,13 +81,16 @@ TrackerKeydot::TrackerKeydot(cv::Size _pattern_size, int flag,
                              cv::SimpleBlobDetector::Params params,
                              cv::SimpleBlobDetector::Params params_roi) :
     last_valid_location(cv::Point2f(200, 200)),
+    bhasLastLocation(false), detect_level(DETECT_NONE), blob_spacing(0), img_scale(1),
     pattern_size(_pattern_size), square_size (1.0f),
     roi_hw(_roi_size.width/2), roi_hh(_roi_size.height/2),
     binitTracker(false), bisTracking(false),
-	pattern_type(flag)
+	pattern_type(flag),
+	blob_params(params), roi_blob_params(params_roi)
 {
-    blob_detector = cv::SimpleBlobDetector::create(params);
-    roi_blob_detector = cv::SimpleBlobDetector::create(params_roi);
+	blob_detector = ParallelBlobDetector::create(blob_params);
+	roi_blob_detector = ParallelBlobDetector::create(roi_blob_params);
+	ApplyBlobArea();
 
     // record model points on the grid
     for( int i = 0; i < pattern_size.height; i++ )
@@ -73,7 +140,7 @@ TrackerKeydot::TrackerKeydot(cv::Size _pattern_size, int flag,
 bool TrackerKeydot::track(const cv::Mat &cur_image)
 {
 	cv::Mat cur_gray;
-	cv::cvtColor(cur_image, cur_gray, cv::COLOR_BGR2GRAY);
+	ScaledGray(cur_image, cur_gray);
 
 	bool found = DetectPattern(cur_gray, curr_dots);
 
@@ -107,13 +174,20 @@ bool TrackerKeydot::track(const cv::Mat &cur_image)
  
  		}
  		else
+		{
+			bhasLastLocation = false;
+			motion_predictor.reset();
+			UpdateBlobArea(0);
 			return false;
+		}
 	}
 
 	// Update tracking and detection for next image
 	if (binitTracker)
 		UpdateLastDots(cur_gray, curr_dots);
 	UpdateLastLocation(curr_dots);
+	UpdateBlobArea(MinDotSpacing(curr_dots));
+	RefineDots(cur_image, curr_dots, img_dots);
 
 
 	return true;
@@ -121,39 +195,255 @@ bool TrackerKeydot::track(const cv::Mat &cur_image)
 
 bool TrackerKeydot::DetectPattern(const cv::Mat& _img_gray, std::vector<cv::Point2f>& _dots)
 {
-	// Two attempts
-	bool found = FindDots(_img_gray, pattern_size, _dots, 
-		pattern_type | cv::CALIB_CB_CLUSTERING, blob_detector);
+	// ROI, wider ROI then full frame if the pattern was found last frame,
+	// otherwise full frame then ROI
+	static const int roi_first[] = {DETECT_ROI, DETECT_ROI_WIDE, DETECT_FULL};
+	static const int full_first[] = {DETECT_FULL, DETECT_ROI};
+	const int *levels = bhasLastLocation ? roi_first : full_first;
+	const int n_levels = bhasLastLocation ? 3 : 2;
+	if (bhasLastLocation)
+		motion_predictor.predict();
+	if (bhasLastLocation && curr_dots.size() == model_dots.size())
+		grid_matcher.predict(curr_dots, motion_predictor.initialised() ?
+			motion_predictor.velocity() : cv::Point2f(0, 0));
+	else
+		grid_matcher.reset();
 
-	if (!found)
+	// Every dot around its predicted position first
+	detect_level = DETECT_NONE;
+	if (bhasLastLocation && curr_dots.size() == model_dots.size() &&
+		RedetectDots(_img_gray, curr_dots, _dots))
 	{
-		// crop a roi for detection
-		cv::Rect rect = cv::Rect((int)last_valid_location.x, (int)last_valid_location.y, 
-			2*roi_hw, 2*roi_hh);
-		rect.x = rect.x < 0? 0 : rect.x;
-		rect.y = rect.y < 0? 0 : rect.y;
-		rect.width = (rect.x+rect.width) 
-		> (_img_gray.cols - 1)? (_img_gray.cols-rect.x-1) : rect.width;
-		rect.height = (rect.y+rect.height) 
-		> (_img_gray.rows - 1)? (_img_gray.rows-rect.y-1) : rect.height;
-
-		cv::Mat roi = _img_gray(rect);
-		found = FindDots(roi, pattern_size, _dots, 
-			pattern_type | cv::CALIB_CB_CLUSTERING, roi_blob_detector);
-		if (found)
+		detect_level = DETECT_LOCAL;
+		return true;
+	}
+
+	bool found = false;
+	for (int i = 0; i < n_levels && !found; i++)
+	{
+		if (levels[i] == DETECT_FULL)
 		{
-			for (unsigned int i = 0; i < _dots.size(); i++)
+			found = FindDots(_img_gray, pattern_size, _dots, 
+				pattern_type | cv::CALIB_CB_CLUSTERING, blob_detector);
+		}
+		else
+		{
+			cv::Rect rect = DetectWindow(_img_gray.size(), levels[i]);
+			if (rect.empty())
+				continue;
+			cv::Mat roi = _img_gray(rect);
+			found = FindDots(roi, pattern_size, _dots, 
+				pattern_type | cv::CALIB_CB_CLUSTERING, roi_blob_detector,
+				cv::Point2f((float)rect.x, (float)rect.y));
+			if (found)
 			{
-				_dots[i].x = _dots[i].x + last_valid_location.x;
-				_dots[i].y = _dots[i].y + last_valid_location.y;
+				for (unsigned int j = 0; j < _dots.size(); j++)
+				{
+					_dots[j].x = _dots[j].x + rect.x;
+					_dots[j].y = _dots[j].y + rect.y;
+				}
 			}
 		}
+		if (found)
+			detect_level = levels[i];
 	}
 	return found;
 }
 
+cv::Rect TrackerKeydot::DetectWindow(const cv::Size& img_size, int level) const
+{
+	int scale = level == DETECT_ROI_WIDE ? 2 : 1;
+	if (motion_predictor.initialised())
+		return motion_predictor.window(img_size, (float)scale);
+
+	// 'last_valid_location' is the top left corner of the ROI
+	const int hw = roi_hw / img_scale, hh = roi_hh / img_scale;
+	int cx = (int)last_valid_location.x + hw;
+	int cy = (int)last_valid_location.y + hh;
+	cv::Rect rect(cx - scale*hw, cy - scale*hh, 2*scale*hw, 2*scale*hh);
+	return rect & cv::Rect(0, 0, img_size.width, img_size.height);
+}
+
+float TrackerKeydot::MinDotSpacing(const std::vector<cv::Point2f>& _dots)
+{
+	float min_d2 = FLT_MAX;
+	for (size_t i = 0; i < _dots.size(); i++)
+		for (size_t j = i + 1; j < _dots.size(); j++)
+		{
+			cv::Point2f d = _dots[i] - _dots[j];
+			min_d2 = std::min(min_d2, d.dot(d));
+		}
+	return min_d2 == FLT_MAX ? 0.f : std::sqrt(min_d2);
+}
+
+int TrackerKeydot::DotWindowRadius(const std::vector<cv::Point2f>& _dots)
+{
+	return std::min(std::max(cvRound(0.45f * MinDotSpacing(_dots)), 4), 15);
+}
+
+bool TrackerKeydot::RedetectDots(const cv::Mat& _img_gray, const std::vector<cv::Point2f>& _prev_dots,
+								 std::vector<cv::Point2f>& _dots, int r)
+{
+	const size_t n = _prev_dots.size();
+	if (n < 4)
+		return false;
+	if (r <= 0)
+		r = DotWindowRadius(_prev_dots);
+
+	const cv::Point2f motion = motion_predictor.initialised() ?
+		motion_predictor.velocity() : cv::Point2f(0, 0);
+
+	// Every dot must be found: one filled in from the others would go to
+	// the pose and the motion predictor as if it had been seen
+	local_dots.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		local_dots[i] = _prev_dots[i] + motion;
+		if (!dotCentroid(_img_gray, r, BrightDots(), local_dots[i]))
+			return false;
+	}
+
+	// A window that caught a neighbouring blob is off the motion of the
+	// others
+	cv::Mat H = cv::findHomography(_prev_dots, local_dots, 0);
+	if (H.empty())
+		return false;
+	cv::perspectiveTransform(_prev_dots, local_proj, H);
+	const float tolerance = std::max(1.5f, 0.25f * r);
+	for (size_t i = 0; i < n; i++)
+		if (cv::norm(local_dots[i] - local_proj[i]) > tolerance)
+			return false;
+
+	_dots = local_dots;
+	return true;
+}
+
+void TrackerKeydot::UpdateBlobArea(float spacing)
+{
+	// not worth reconfiguring for less than 10%
+	if (spacing > 0 && blob_spacing > 0 && std::fabs(spacing - blob_spacing) < 0.1f * blob_spacing)
+		return;
+	if (spacing <= 0 && blob_spacing <= 0)
+		return;
+	blob_spacing = spacing > 0 ? spacing : 0;
+	ApplyBlobArea();
+}
+
+void TrackerKeydot::ApplyBlobArea()
+{
+	cv::SimpleBlobDetector::Params params = ScaledBlobParams(blob_params);
+	cv::SimpleBlobDetector::Params params_roi = ScaledBlobParams(roi_blob_params);
+	if (blob_spacing > 0)
+	{
+		// dot radius from a tenth to half of the spacing
+		const float min_area = (float)CV_PI * 0.01f * blob_spacing * blob_spacing;
+		const float max_area = (float)CV_PI * 0.25f * blob_spacing * blob_spacing;
+		cv::SimpleBlobDetector::Params *p[] = {&params, &params_roi};
+		for (int i = 0; i < 2; i++)
+		{
+			if (!p[i]->filterByArea)
+			{
+				p[i]->filterByArea = true;
+				p[i]->minArea = min_area;
+				p[i]->maxArea = max_area;
+			}
+			else if (std::max(p[i]->minArea, min_area) < std::min(p[i]->maxArea, max_area))
+			{
+				p[i]->minArea = std::max(p[i]->minArea, min_area);
+				p[i]->maxArea = std::min(p[i]->maxArea, max_area);
+			}
+		}
+	}
+	ApplyBlobParams(blob_detector, params);
+	ApplyBlobParams(roi_blob_detector, params_roi);
+}
+
+void TrackerKeydot::ApplyBlobParams(cv::Ptr<cv::FeatureDetector>& detector,
+									const cv::SimpleBlobDetector::Params& params)
+{
+	cv::Ptr<ParallelBlobDetector> sweep = detector.dynamicCast<ParallelBlobDetector>();
+	if (sweep)
+		sweep->setParams(params);
+}
+
+void TrackerKeydot::SetImageScale(int scale)
+{
+	scale = std::max(scale, 1);
+	if (scale == img_scale)
+		return;
+	img_scale = scale;
+
+	// the last location and tracking are in the old coordinates
+	binitTracker = false;
+	bhasLastLocation = false;
+	detect_level = DETECT_NONE;
+	motion_predictor.reset();
+	curr_dots.clear();
+	img_dots.clear();
+	blob_spacing = 0;
+	ApplyBlobArea();
+}
+
+void TrackerKeydot::ScaledGray(const cv::Mat& image, cv::Mat& gray)
+{
+	if (img_scale <= 1)
+	{
+		cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+		return;
+	}
+	// whole blocks of 'img_scale' pixels only, so that the downsampling
+	// is exactly 'img_scale' times
+	const cv::Size size(image.cols / img_scale, image.rows / img_scale);
+	cv::resize(image(cv::Rect(0, 0, size.width * img_scale, size.height * img_scale)),
+		scaled_image, size, 0, 0, cv::INTER_AREA);
+	cv::cvtColor(scaled_image, gray, cv::COLOR_BGR2GRAY);
+}
+
+cv::SimpleBlobDetector::Params TrackerKeydot::ScaledBlobParams(const cv::SimpleBlobDetector::Params& params) const
+{
+	cv::SimpleBlobDetector::Params scaled = params;
+	scaled.minArea = params.minArea / (img_scale * img_scale);
+	scaled.maxArea = params.maxArea / (img_scale * img_scale);
+	scaled.minDistBetweenBlobs = params.minDistBetweenBlobs / img_scale;
+	return scaled;
+}
+
+void TrackerKeydot::ToImageCoords(std::vector<cv::Point2f>& pts, float centre) const
+{
+	// a pixel of the downsampled image is the mean of a block of
+	// 'img_scale' x 'img_scale' pixels, their centres match
+	const float s = (float)img_scale, offset = (0.5f - centre) * (img_scale - 1);
+	for (size_t i = 0; i < pts.size(); i++)
+		pts[i] = cv::Point2f(pts[i].x * s + offset, pts[i].y * s + offset);
+}
+
+void TrackerKeydot::RefineDots(const cv::Mat& image, const std::vector<cv::Point2f>& _dots,
+							   std::vector<cv::Point2f>& _img_dots)
+{
+	_img_dots = _dots;
+	if (img_scale <= 1)
+		return;
+	ToImageCoords(_img_dots);
+
+	const int r = std::min(std::max(cvRound(0.45f * img_scale * MinDotSpacing(_dots)), 4), 15 * img_scale);
+	const cv::Rect frame(0, 0, image.cols, image.rows);
+	for (size_t i = 0; i < _img_dots.size(); i++)
+	{
+		// the second centroid window is within 'r' of the first one
+		const cv::Rect rect = cv::Rect(cvRound(_img_dots[i].x) - 2 * r, cvRound(_img_dots[i].y) - 2 * r,
+			4 * r + 1, 4 * r + 1) & frame;
+		if (rect.empty())
+			continue;
+		cv::cvtColor(image(rect), refine_gray, cv::COLOR_BGR2GRAY);
+		cv::Point2f pt = _img_dots[i] - cv::Point2f((float)rect.x, (float)rect.y);
+		if (dotCentroid(refine_gray, r, BrightDots(), pt))
+			_img_dots[i] = pt + cv::Point2f((float)rect.x, (float)rect.y);
+	}
+}
+
 bool TrackerKeydot::FindDots(cv::InputArray _image, cv::Size patternSize, cv::OutputArray _centers,
-								int flags, const cv::Ptr<cv::FeatureDetector> &blobDetector)
+								int flags, const cv::Ptr<cv::FeatureDetector> &blobDetector,
+								const cv::Point2f &_origin)
 {
 	bool isAsymmetricGrid = (flags & cv::CALIB_CB_ASYMMETRIC_GRID) ? true : false;
 	bool isSymmetricGrid  = (flags & cv::CALIB_CB_SYMMETRIC_GRID ) ? true : false;
@@ -170,6 +460,14 @@ bool TrackerKeydot::FindDots(cv::InputArray _image, cv::Size patternSize, cv::Ou
 		points.push_back(keypoints[i].pt);
 	}
 
+	// The dots of the last frame at their predicted positions first
+	std::vector<int> indices;
+	if (grid_matcher.match(points, _origin, centers, indices))
+	{
+		cv::Mat(centers).copyTo(_centers);
+		return true;
+	}
+
 	if(flags & cv::CALIB_CB_CLUSTERING)
 	{
 		CirclesGridClusterFinder circlesGridClusterFinder(isAsymmetricGrid, patternSize.width == 1);
@@ -253,8 +551,10 @@ void TrackerKeydot::UpdateLastLocation(const std::vector<cv::Point2f>& _dots)
 		{
 			pt += _dots[i];
 		}
-		last_valid_location.x = static_cast<float>(cvRound(pt.x/_dots.size() - roi_hw));
-		last_valid_location.y = static_cast<float>(cvRound(pt.y/_dots.size() - roi_hh));
+		last_valid_location.x = static_cast<float>(cvRound(pt.x/_dots.size() - roi_hw/img_scale));
+		last_valid_location.y = static_cast<float>(cvRound(pt.y/_dots.size() - roi_hh/img_scale));
+		bhasLastLocation = true;
+		motion_predictor.correct(_dots);
 	}
 }
 
@@ -345,15 +645,16 @@ void TrackerKeydot::drawKeydots(cv::InputOutputArray _image)
 	bgr = bisTracking ? cv::Scalar(0, 255, 255) : cv::Scalar(0, 255, 0);
 
 	cv::perspectiveTransform(corner_pts, curr_corners, homography);
+	ToImageCoords(curr_corners);
 
 	
-	for (unsigned int i = 0; i < curr_dots.size(); i++)
+	for (unsigned int i = 0; i < img_dots.size(); i++)
 	{
-		cv::circle(image, curr_dots[i], 4, dot_colors[i], 1, CV_AA);
-		cv::line(image, cv::Point2f(curr_dots[i].x-3, curr_dots[i].y), 
-			cv::Point2f(curr_dots[i].x+3, curr_dots[i].y), dot_colors[i]);
-		cv::line(image,cv::Point2f( curr_dots[i].x, curr_dots[i].y-3),
-			cv::Point2f(curr_dots[i].x, curr_dots[i].y+3), dot_colors[i] );
+		cv::circle(image, img_dots[i], 4, dot_colors[i], 1, CV_AA);
+		cv::line(image, cv::Point2f(img_dots[i].x-3, img_dots[i].y), 
+			cv::Point2f(img_dots[i].x+3, img_dots[i].y), dot_colors[i]);
+		cv::line(image,cv::Point2f( img_dots[i].x, img_dots[i].y-3),
+			cv::Point2f(img_dots[i].x, img_dots[i].y+3), dot_colors[i] );
 	}
 
 	cv::line(image, curr_corners[0], curr_corners[1], bgr, 2, CV_AA);
@@ -365,5 +666,6 @@ void TrackerKeydot::drawKeydots(cv::InputOutputArray _image)
 
 std::vector<cv::Point2f> TrackerKeydot::get_corners() {
 	cv::perspectiveTransform(corner_pts, curr_corners, homography);
+	ToImageCoords(curr_corners);
 	return curr_corners;
 }
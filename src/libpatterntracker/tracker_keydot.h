@@ -18,10 +18,22 @@
 #include <opencv2/opencv.hpp>
 #include "circlesgrid.hpp"
 #include "tracker.h"
+#include "motion_predictor.h"
+#include "temporal_grid_matcher.h"
 
 class TrackerKeydot : public Tracker
 {
 public:
+	// Where the pattern was detected, tried in this order when the previous
+	// frame had the pattern: each dot in a small window around its predicted
+	// position, the ROI around the marker, the ROI twice as large, then the
+	// full frame. Otherwise the full frame first, then the ROI.
+	enum DetectLevel { DETECT_NONE = -1,
+		DETECT_LOCAL = 0,
+		DETECT_ROI = 1,
+		DETECT_ROI_WIDE = 2,
+		DETECT_FULL = 3};
+
 	TrackerKeydot(cv::Size _pattern_size = cv::Size(3, 7), cv::Size _roi_size = cv::Size(100, 100),
 		cv::SimpleBlobDetector::Params params = cv::SimpleBlobDetector::Params(),
 		cv::SimpleBlobDetector::Params params_roi = cv::SimpleBlobDetector::Params());
@@ -39,12 +51,26 @@ public:
 	// --- Detection part ---
 	bool DetectPattern(const cv::Mat& _img_gray, std::vector<cv::Point2f>& _dots);
 
+	// '_origin': top left corner of '_image' in the frame (ROI)
 	bool FindDots( cv::InputArray _image, cv::Size patternSize,
 		cv::OutputArray _centers, int flags,
-		const cv::Ptr<cv::FeatureDetector> &blobDetector);
+		const cv::Ptr<cv::FeatureDetector> &blobDetector,
+		const cv::Point2f &_origin = cv::Point2f());
 
 	void UpdateLastLocation(const std::vector<cv::Point2f>& _dots);
 
+	// Level the pattern was detected at in the last frame (DetectLevel)
+	inline int CurrDetectLevel() const { return detect_level; }
+
+	// Fraction of frames whose predicted ROI held the whole marker
+	inline float PredictorHitRate() const { return motion_predictor.hitRate(); }
+
+	// Detect and track on the input downsampled 'scale' times (grayscale
+	// conversion included), the output dots are then refined at full
+	// resolution. 1: full resolution. A new scale restarts the tracking
+	virtual void SetImageScale(int scale);
+	inline int ImageScale() const { return img_scale; }
+
 
 	// --- Tracking part ---
 	void initTrack(std::vector<cv::Point2f> _model_dots, cv::Mat& _pre_gray,
@@ -67,7 +93,7 @@ public:
 
 
 	// get points in image coordinate
-	inline std::vector<cv::Point2f> getP_img() { return curr_dots; }
+	inline std::vector<cv::Point2f> getP_img() { return img_dots; }
 	// Get corners coordinate, index start from origin clockwise
 	std::vector<cv::Point2f> get_corners();
 
@@ -75,14 +101,87 @@ protected:
 
 	// --- Dection part ---
 	cv::Point2f last_valid_location; // random value for initialisation
+	// true if the pattern was found (detected or tracked) in the last frame
+	bool bhasLastLocation;
+	int detect_level;
+	// predicts the marker location and size for the ROI
+	MotionPredictor motion_predictor;
+	// the dots of the last frame looked for among the keypoints of
+	// FindDots, before the grid finder
+	TemporalGridMatcher grid_matcher;
 	int roi_hw;
 	int roi_hh;
 	cv::Size pattern_size;
 	float square_size;
+	// dot detectors (threshold sweep, levels in parallel), configured
+	// by the blob detector parameters of the constructor
 	cv::Ptr<cv::FeatureDetector> blob_detector;
 	cv::Ptr<cv::FeatureDetector> roi_blob_detector;
+	cv::SimpleBlobDetector::Params blob_params;
+	cv::SimpleBlobDetector::Params roi_blob_params;
 	int pattern_type;
 
+	// ROI of 'level' (DETECT_ROI or DETECT_ROI_WIDE) around the predicted
+	// (last if no prediction) location, clipped to an image of 'img_size'
+	cv::Rect DetectWindow(const cv::Size& img_size, int level) const;
+
+	// Re-detect the dots '_prev_dots' of the last frame, each in a small
+	// window around its predicted position, into '_dots' (same order).
+	// False if any dot is not found or is off the homography between the
+	// two frames fitted on all of them (the full detection runs then).
+	// 'r': half size of the windows, 0 for DotWindowRadius(_prev_dots)
+	bool RedetectDots(const cv::Mat& _img_gray, const std::vector<cv::Point2f>& _prev_dots,
+		std::vector<cv::Point2f>& _dots, int r = 0);
+
+	// Window half size for the dots: a bit less than half the distance
+	// between the closest two
+	static int DotWindowRadius(const std::vector<cv::Point2f>& _dots);
+
+	// Distance between the closest two dots, 0 if less than two
+	static float MinDotSpacing(const std::vector<cv::Point2f>& _dots);
+
+	// True if the blob detectors look for bright dots (blobColor 255),
+	// false for dark ones (default)
+	inline bool BrightDots() const { return blob_params.filterByColor && blob_params.blobColor == 255; }
+
+	// Narrow the area window of the blob detectors to the dots of a marker
+	// whose closest dots are 'spacing' pixels apart (within the constructor
+	// parameters). 0 restores the constructor parameters
+	void UpdateBlobArea(float spacing);
+	// Set the blob detectors to the constructor parameters, scaled to
+	// 'img_scale' and narrowed to 'blob_spacing'
+	void ApplyBlobArea();
+	void ApplyBlobParams(cv::Ptr<cv::FeatureDetector>& detector,
+		const cv::SimpleBlobDetector::Params& params);
+	// spacing the blob detectors are set for, 0 if none
+	float blob_spacing;
+	std::vector<cv::Point2f> local_dots, local_proj;
+
+	// Downsampling of the input. The state of the tracker (dots, windows,
+	// tracking) is in the coordinates of the downsampled image
+	int img_scale;
+	cv::Mat scaled_image;
+	// grayscale window of a dot at full resolution
+	cv::Mat refine_gray;
+
+	// Grayscale of 'image' downsampled 'img_scale' times
+	void ScaledGray(const cv::Mat& image, cv::Mat& gray);
+
+	// Blob detector parameters for the downsampled image
+	cv::SimpleBlobDetector::Params ScaledBlobParams(const cv::SimpleBlobDetector::Params& params) const;
+
+	// Points of the downsampled image to the full resolution one, in place.
+	// 'centre': position of the centre of a pixel within it, 0 for blob
+	// keypoints, 0.5 for the points of the chess detector
+	void ToImageCoords(std::vector<cv::Point2f>& pts, float centre = 0.f) const;
+
+	// '_dots' of the downsampled image to full resolution '_img_dots', each
+	// moved to the centroid of its dot in 'image' (full resolution, only
+	// the windows of the dots are converted to grayscale). Dots not found
+	// there are only scaled
+	void RefineDots(const cv::Mat& image, const std::vector<cv::Point2f>& _dots,
+		std::vector<cv::Point2f>& _img_dots);
+
 	// --- Tracking part ---
 	bool binitTracker;
 	cv::Mat pre_gray;
@@ -93,6 +192,8 @@ protected:
 
 	std::vector<cv::Point2f> curr_dots;
 	std::vector<cv::Point2f> curr_corners;
+	// 'curr_dots' at full resolution
+	std::vector<cv::Point2f> img_dots;
 
 
 	// --- Draw ---
@@ -24,7 +24,7 @@ int main(int argc, char *argv[])
 		if (!vid_cap.read(img))
 			break;
 
-		//resize(img, img, cv::Size(), 0.5, 0.5, cv::INTER_LINEAR);	for re-scale video
+		// detection at a lower resolution: 'image_Scale' in Settings.xml
 		track_helper.process(img, img_track);
 
 		imshow("marker tracking", img_track);
@@ -1,5 +1,6 @@
 #include "track_helper.h"
 #include <cmath>
+#include <algorithm>
 
 TrackHelper::TrackHelper (std::string filename) :
   tracker(NULL)
@@ -23,6 +24,9 @@ TrackHelper::TrackHelper (std::string filename) :
 
 	fs["image_Width" ] >> img_size.width;
 	fs["image_Height"] >> img_size.height;
+	int scale = 1;
+	fs["image_Scale"] >> scale;
+	img_scale = std::max(scale, 1);
 	fs["Camera_Matrix"] >> cameraMatrix;
 	fs["Distortion_Coefficients"] >> distCoeffs;
 
@@ -176,6 +180,9 @@ TrackHelper::TrackHelper (std::string filename) :
 		std::cerr << "Unknow pattern type" << std::endl;
 		exit(0);
 	}
+
+	// Detection at 1/img_scale, points refined at full resolution
+	static_cast<TrackerKeydot*>(tracker)->SetImageScale(img_scale);
 }
 
 TrackHelper::~TrackHelper()
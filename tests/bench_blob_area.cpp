@@ -0,0 +1,174 @@
+/*
+	Candidates and FindDots time of TrackerKeydot with the blob detectors
+	of TrackHelper (ParallelBlobDetector, area 50 to 1000), as configured
+	(no marker tracked) and with the area window narrowed to the spacing of
+	the tracked marker (UpdateBlobArea). Frames of 960x540 with clutter of
+	dark blobs of all sizes and the 3x7 marker at three sizes. Not a test:
+	run by hand, optionally with the number of milliseconds to spend on
+	each frame (default 200). Exits with 1 if the narrowed window loses a
+	marker the full one finds
+*/
+
+#include "tracker_keydot.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::duration d)
+{
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+// The detectors and the area window of the tracker, from outside
+class AreaTracker : public TrackerKeydot
+{
+public:
+	AreaTracker(const cv::SimpleBlobDetector::Params &params) :
+		TrackerKeydot(cv::Size(3, 7), cv::CALIB_CB_ASYMMETRIC_GRID, cv::Size(300, 300), params, params)
+	{
+	}
+
+	// Area window of a tracked marker whose dots are 'dots', none if empty
+	void Narrow(const std::vector<cv::Point2f> &dots)
+	{
+		UpdateBlobArea(dots.empty() ? 0.f : MinDotSpacing(dots));
+	}
+
+	inline const cv::Ptr<cv::FeatureDetector> &Detector() const { return blob_detector; }
+};
+
+// Global blob detector of TrackHelper
+static cv::SimpleBlobDetector::Params HelperParams()
+{
+	cv::SimpleBlobDetector::Params params;
+	params.minRepeatability = 2;
+	params.minDistBetweenBlobs = 10;
+	params.minThreshold = 80;
+	params.maxThreshold = 160;
+	params.thresholdStep = 20;
+	params.filterByArea = true;
+	params.minArea = 50;
+	params.maxArea = 1000;
+	params.filterByConvexity = true;
+	params.minConvexity = 0.85f;
+	params.maxConvexity = 1.0f;
+	params.filterByCircularity = true;
+	params.minCircularity = 0.7f;
+	params.maxCircularity = 1.0f;
+	params.filterByInertia = false;
+	params.minInertiaRatio = 0.01f;
+	return params;
+}
+
+// Smooth shading, 'clutter' dark blobs of radius 2 to 22 and elongation up
+// to 2.5 away from the marker, and the marker: the 3x7 asymmetric grid of
+// dots 'spacing' apart (dot radius 0.22 'spacing') on white. Blurred, with
+// noise. 'dots': centres of the marker dots
+static cv::Mat RenderFrame(float spacing, int clutter, unsigned seed, std::vector<cv::Point2f> &dots)
+{
+	cv::RNG rng(seed);
+	cv::Mat frame(540, 960, CV_8UC1);
+	for (int y = 0; y < frame.rows; y++)
+	{
+		uchar *row = frame.ptr<uchar>(y);
+		for (int x = 0; x < frame.cols; x++)
+			row[x] = cv::saturate_cast<uchar>(150 + 40 * std::sin(x * 0.01 + seed) * std::cos(y * 0.013));
+	}
+
+	const cv::Point2f origin(300 + rng.uniform(0.f, 300.f), 40 + rng.uniform(0.f, 480 - 6 * spacing - 40));
+	const cv::Rect marker(cvRound(origin.x - spacing), cvRound(origin.y - spacing),
+		cvRound(7 * spacing), cvRound(8 * spacing));
+	const cv::Rect keep_out(marker.x - 25, marker.y - 25, marker.width + 50, marker.height + 50);
+	for (int i = 0; i < clutter; i++)
+	{
+		const cv::Point2f c(rng.uniform(0.f, 960.f), rng.uniform(0.f, 540.f));
+		const float a = rng.uniform(2.f, 22.f), b = a * rng.uniform(0.4f, 1.f);
+		if (keep_out.contains(c))
+			continue;
+		cv::ellipse(frame, cv::RotatedRect(c, cv::Size2f(2 * a, 2 * b), rng.uniform(0.f, 180.f)),
+			cv::Scalar(rng.uniform(20, 90)), -1, cv::LINE_AA);
+	}
+
+	cv::rectangle(frame, marker, cv::Scalar(235), -1);
+	dots.clear();
+	for (int i = 0; i < 7; i++)
+		for (int j = 0; j < 3; j++)
+		{
+			dots.push_back(origin + cv::Point2f((2 * j + i % 2) * spacing, i * spacing));
+			cv::circle(frame, cv::Point(cvRound(dots.back().x * 16), cvRound(dots.back().y * 16)),
+				cvRound(0.22f * spacing * 16), cv::Scalar(30), -1, cv::LINE_AA, 4);
+		}
+
+	cv::GaussianBlur(frame, frame, cv::Size(3, 3), 1.);
+	cv::Mat noise(frame.size(), CV_16SC1);
+	cv::randn(noise, 0, 3);
+	cv::add(frame, noise, frame, cv::noArray(), CV_8U);
+	return frame;
+}
+
+int main(int argc, char **argv)
+{
+	const double budget_ms = argc > 1 ? atof(argv[1]) : 200.;
+	const float spacings[] = { 20.f, 30.f, 45.f };
+	const int frames = 10, clutter = 150;
+	const int flags = cv::CALIB_CB_ASYMMETRIC_GRID | cv::CALIB_CB_CLUSTERING;
+	bool kept = true;
+
+	printf("%8s %22s %22s %16s\n", "spacing", "candidates full/narrow", "FindDots ms full/narrow", "found full/narrow");
+	for (size_t s = 0; s < sizeof(spacings) / sizeof(spacings[0]); s++)
+	{
+		// totals over the frames, [0] full window, [1] narrowed
+		double candidates[2] = {0, 0}, ms[2] = {0, 0};
+		int found[2] = {0, 0};
+		for (int f = 0; f < frames; f++)
+		{
+			std::vector<cv::Point2f> dots, centers;
+			const cv::Mat frame = RenderFrame(spacings[s], clutter, (unsigned)(s * 100 + f), dots);
+			AreaTracker full(HelperParams()), narrow(HelperParams());
+			AreaTracker *tracker[2] = {&full, &narrow};
+			full.Narrow(std::vector<cv::Point2f>());
+			narrow.Narrow(dots);
+
+			bool ok[2];
+			for (int k = 0; k < 2; k++)
+			{
+				std::vector<cv::KeyPoint> keypoints;
+				tracker[k]->Detector()->detect(frame, keypoints);
+				candidates[k] += keypoints.size();
+				ok[k] = tracker[k]->FindDots(frame, cv::Size(3, 7), centers, flags, tracker[k]->Detector());
+				found[k] += ok[k];
+			}
+			kept = kept && (ok[1] || !ok[0]);
+
+			// alternate the two so that both see the same cache state
+			double frame_ms[2] = {0, 0};
+			int runs = 0;
+			do
+			{
+				for (int k = 0; k < 2; k++)
+				{
+					Clock::time_point t0 = Clock::now();
+					tracker[k]->FindDots(frame, cv::Size(3, 7), centers, flags, tracker[k]->Detector());
+					frame_ms[k] += Milliseconds(Clock::now() - t0);
+				}
+				runs++;
+			} while (frame_ms[0] + frame_ms[1] < budget_ms);
+			for (int k = 0; k < 2; k++)
+				ms[k] += frame_ms[k] / runs;
+		}
+
+		printf("%8.0f %11.1f /%9.1f %11.2f /%9.2f %8d /%6d\n", spacings[s],
+			candidates[0] / frames, candidates[1] / frames, ms[0] / frames, ms[1] / frames,
+			found[0], found[1]);
+	}
+
+	printf(kept ? "no marker lost\n" : "MARKER LOST\n");
+	return kept ? 0 : 1;
+}
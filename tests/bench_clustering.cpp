@@ -0,0 +1,78 @@
+/*
+	Time of the single linkage clustering of the dot candidates,
+	neighbour graph (CirclesGridClusterFinder::hierarchicalClustering())
+	against the dense matrix it replaced: the 3x7 grid of the marker and 20
+	to 2000 clutter candidates spread over a 1280x720 frame. Not a
+	test: run by hand, optionally with the number of milliseconds to spend
+	on each case (default 200, at least one run of each)
+*/
+
+#include "circlesgrid.hpp"
+#include "clustering_reference.h"
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::duration d)
+{
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+int main(int argc, char **argv)
+{
+	const double budget_ms = argc > 1 ? atof(argv[1]) : 200.;
+	const int counts[] = { 20, 50, 100, 200, 500, 1000, 2000 };
+	const cv::Size pattern(3, 7);
+	bool same = true;
+
+	printf("%6s %8s %12s %12s %9s\n", "n", "cluster", "matrix ms", "graph ms", "speedup");
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+	{
+		const int n = counts[c];
+		srand(n);
+		std::vector<cv::Point2f> pts;
+		for (int i = 0; i < n; i++)
+			pts.push_back(cv::Point2f(1280.f * rand() / RAND_MAX, 720.f * rand() / RAND_MAX));
+		for (int i = 0; i < pattern.height; i++)
+			for (int j = 0; j < pattern.width; j++)
+				pts.push_back(cv::Point2f(600 + (2 * j + i % 2) * 12.f, 300 + i * 12.f));
+		for (size_t i = pts.size(); i > 1; i--)
+			std::swap(pts[i - 1], pts[rand() % i]);
+
+		CirclesGridClusterFinder finder(true);
+		std::vector<cv::Point2f> expected, actual;
+
+		// the dense matrix is O(n^3): its own budget, at least one run
+		double matrix_ms = 0, graph_ms = 0;
+		int matrix_runs = 0, graph_runs = 0;
+		do
+		{
+			Clock::time_point t0 = Clock::now();
+			hierarchicalClusteringRef(pts, pattern, expected);
+			matrix_ms += Milliseconds(Clock::now() - t0);
+			matrix_runs++;
+		} while (matrix_ms < budget_ms / 2);
+		do
+		{
+			Clock::time_point t0 = Clock::now();
+			finder.hierarchicalClustering(pts, pattern, actual);
+			graph_ms += Milliseconds(Clock::now() - t0);
+			graph_runs++;
+		} while (graph_ms < budget_ms / 2);
+
+		same = same && expected == actual;
+		matrix_ms /= matrix_runs;
+		graph_ms /= graph_runs;
+		printf("%6d %8d %12.3f %12.3f %8.1fx\n", n, (int)actual.size(), matrix_ms, graph_ms,
+			matrix_ms / graph_ms);
+	}
+
+	printf(same ? "same clusters\n" : "MISMATCH\n");
+	return same ? 0 : 1;
+}
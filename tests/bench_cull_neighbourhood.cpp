@@ -0,0 +1,88 @@
+/*
+	Time of the neighbourhood cull of non-maximum suppression, grid
+	(non_max_sup_finish(), storing the survivors included) against the
+	O(n^2) scan, for 10 to 5000 candidates spread over a 1080p frame.
+	Not a test: run by hand, optionally with the number of milliseconds
+	to spend on each case (default 100)
+*/
+
+#include "non_max_sup_pts.h"
+#include "chess_features.h"
+#include "cull_reference.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double Microseconds(Clock::duration d)
+{
+	return std::chrono::duration<double, std::micro>(d).count();
+}
+
+int main(int argc, char **argv)
+{
+	const double budget_us = 1000. * (argc > 1 ? atof(argv[1]) : 100.);
+	const int w = 1920, h = 1080;
+	const int counts[] = { 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+	const char search_sizes[] = { 10, 20, 40 };
+
+	non_max_sup_workspace ws;
+	void *points = NULL;
+	bool same = true;
+
+	printf("%6s %6s %8s %12s %12s %8s\n", "n", "size", "kept", "O(n^2) us", "grid us", "speedup");
+	for (size_t s = 0; s < sizeof(search_sizes); s++)
+		for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+		{
+			const int n = counts[c];
+			srand(n * 31 + s);
+			std::vector<consider_point> base(n);
+			for (int i = 0; i < n; i++)
+			{
+				base[i].valid = true;
+				base[i].coord.x = rand() % w;
+				base[i].coord.y = rand() % h;
+				base[i].max = (uint16_t)(rand() % 2000);
+				base[i].mass = rand() % 50000;
+				base[i].com.x = (float)base[i].coord.x;
+				base[i].com.y = (float)base[i].coord.y;
+			}
+			non_max_sup_reserve(&ws, n, 1, 1, 1);
+			reserve_point_list(&points, n);
+
+			// alternate the two so that both see the same cache state
+			std::vector<consider_point> a, b;
+			double ref_us = 0, grid_us = 0;
+			int runs = 0, kept = 0;
+			do
+			{
+				a = base;
+				Clock::time_point t0 = Clock::now();
+				const int culled = cull_neighbourhood_ref(n, &a[0], search_sizes[s]);
+				Clock::time_point t1 = Clock::now();
+
+				b = base;
+				Clock::time_point t2 = Clock::now();
+				kept = non_max_sup_finish(0, NULL, 0, true, search_sizes[s], &b[0], n,
+					&ws, append_pl_point, points);
+				Clock::time_point t3 = Clock::now();
+
+				ref_us += Microseconds(t1 - t0);
+				grid_us += Microseconds(t3 - t2);
+				same = same && kept == n - culled;
+				runs++;
+			} while (ref_us + grid_us < budget_us);
+
+			for (int i = 0; i < n; i++)
+				same = same && a[i].valid == b[i].valid;
+			printf("%6d %6d %8d %12.2f %12.2f %7.1fx\n", n, search_sizes[s], kept,
+				ref_us / runs, grid_us / runs, ref_us / grid_us);
+		}
+
+	free_point_list(points);
+	printf(same ? "same candidates kept\n" : "MISMATCH\n");
+	return same ? 0 : 1;
+}
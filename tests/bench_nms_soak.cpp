@@ -0,0 +1,105 @@
+/*
+	Soak of the response and non-maximum suppression stages of
+	ChessDetector, with the storage it keeps from frame to frame: one
+	non_max_sup_workspace and one point list, reused. Frames cycle
+	through checkerboards of several square sizes and noise, so the
+	number of candidates and points changes from frame to frame.
+	Resident memory must stay flat once the first frames have sized the
+	storage. Not a test: run by hand, optionally with the number of frames
+	(default 1000000). Exits with 1 if memory grew
+*/
+
+#include "corner_detect.h"
+#include "non_max_sup_pts.h"
+#include "chess_features.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+
+// Resident set size in kB
+static long ResidentKB()
+{
+	long pages = 0, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char **argv)
+{
+	const long frames = argc > 1 ? atol(argv[1]) : 1000000;
+	const int w = 640, h = 480, n_frames = 32;
+	const unsigned radius = 10;
+	const char neighbourhood = 20;
+
+	// responses of the frames cycled through
+	std::vector<std::vector<int16_t> > responses(n_frames, std::vector<int16_t>(w * h));
+	std::vector<int16_t> maxima(n_frames);
+	std::vector<uint8_t> img(w * h);
+	for (int f = 0; f < n_frames; f++)
+	{
+		srand(f);
+		const int square = 12 + f % 20, noise = 4 + f % 5 * 5;
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+				img[y * w + x] = (uint8_t)((((x / square) + (y / (square + 3))) & 1) ?
+					255 - rand() % noise : rand() % noise);
+		maxima[f] = corner_detect5_rows(w, h, &img[0], w, &responses[f][0], w, 0, h);
+	}
+
+	non_max_sup_workspace ws;
+	void *points = NULL;
+	long warm_kb = 0, peak_kb = 0, total_points = 0;
+	const long warm_up = std::min(frames, 1000L);
+
+	// stdout and the reading of the resident size allocate on first use,
+	// get that done before the frames
+	printf("%ld frames of %dx%d, resident %ld kB\n", frames, w, h, ResidentKB());
+	fflush(stdout);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (long frame = 0; frame < frames; frame++)
+	{
+		std::vector<int16_t> &resp = responses[frame % n_frames];
+		const int thresh = maxima[frame % n_frames] >> 1;
+
+		// as ChessDetector::detectPoints(), in one band
+		const int capacity = non_max_sup_reserve(&ws, w, h, radius, 1);
+		const int found = non_max_sup_search(w, h, w, &resp[0], 7, radius, thresh, false,
+			0, h, &ws.cp[0], capacity);
+		if (found > 0 && reserve_point_list(&points, found))
+			total_points += non_max_sup_finish(w, &resp[0], thresh, false, neighbourhood,
+				&ws.cp[0], found, &ws, append_pl_point, points);
+
+		if (frame + 1 == warm_up)
+			warm_kb = ResidentKB();
+		if (frame >= warm_up && (frame + 1) % 1000 == 0)
+			peak_kb = std::max(peak_kb, ResidentKB());
+		if ((frame + 1) % 100000 == 0)
+		{
+			printf("frame %7ld: resident %ld kB\n", frame + 1, ResidentKB());
+			fflush(stdout);
+		}
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	free_point_list(points);
+
+	peak_kb = std::max(peak_kb, warm_kb);
+	printf("%ld frames, %.1f points per frame, %.1f us per frame\n", frames,
+		(double)total_points / frames, 1e6 * seconds / frames);
+	printf("resident after %ld frames: %ld kB, largest after: %ld kB\n", warm_up, warm_kb, peak_kb);
+
+	// slack for the C library's own bookkeeping; leaking even a few bytes
+	// a frame would show as megabytes
+	const bool flat = peak_kb <= warm_kb + 64;
+	printf(flat ? "flat\n" : "GREW\n");
+	return flat ? 0 : 1;
+}
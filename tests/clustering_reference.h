@@ -0,0 +1,81 @@
+/*
+	The single linkage clustering of CirclesGridClusterFinder before the
+	neighbour graph: a dense distance matrix, the nearest pair found with
+	minMaxLoc. CandidateIndex must give the same clusters, with their
+	points in the same order
+*/
+
+#ifndef CLUSTERING_REFERENCE_H
+#define CLUSTERING_REFERENCE_H
+
+#include <opencv2/core.hpp>
+
+#include <list>
+#include <vector>
+
+inline void hierarchicalClusteringRef(const std::vector<cv::Point2f> &points, const cv::Size &patternSz, std::vector<cv::Point2f> &patternPoints)
+{
+    using namespace cv;
+    int j, n = (int)points.size();
+    size_t pn = static_cast<size_t>(patternSz.area());
+
+    patternPoints.clear();
+    if (pn >= points.size())
+    {
+        if (pn == points.size())
+            patternPoints = points;
+        return;
+    }
+
+    Mat dists(n, n, CV_32FC1, Scalar(0));
+    Mat distsMask(dists.size(), CV_8UC1, Scalar(0));
+    for(int i = 0; i < n; i++)
+    {
+        for(j = i+1; j < n; j++)
+        {
+            dists.at<float>(i, j) = (float)norm(points[i] - points[j]);
+            distsMask.at<uchar>(i, j) = 255;
+            distsMask.at<uchar>(j, i) = 255;
+            dists.at<float>(j, i) = dists.at<float>(i, j);
+        }
+    }
+
+    std::vector<std::list<size_t> > clusters(points.size());
+    for(size_t i=0; i<points.size(); i++)
+    {
+        clusters[i].push_back(i);
+    }
+
+    int patternClusterIdx = 0;
+    while(clusters[patternClusterIdx].size() < pn)
+    {
+        Point minLoc;
+        minMaxLoc(dists, 0, 0, &minLoc, 0, distsMask);
+        int minIdx = std::min(minLoc.x, minLoc.y);
+        int maxIdx = std::max(minLoc.x, minLoc.y);
+
+        distsMask.row(maxIdx).setTo(0);
+        distsMask.col(maxIdx).setTo(0);
+        Mat tmpRow = dists.row(minIdx);
+        Mat tmpCol = dists.col(minIdx);
+        cv::min(dists.row(minLoc.x), dists.row(minLoc.y), tmpRow);
+        tmpRow.copyTo(tmpCol);
+
+        clusters[minIdx].splice(clusters[minIdx].end(), clusters[maxIdx]);
+        patternClusterIdx = minIdx;
+    }
+
+    //the largest cluster can have more than pn points -- we need to filter out such situations
+    if(clusters[patternClusterIdx].size() != static_cast<size_t>(patternSz.area()))
+    {
+      return;
+    }
+
+    patternPoints.reserve(clusters[patternClusterIdx].size());
+    for(std::list<size_t>::iterator it = clusters[patternClusterIdx].begin(); it != clusters[patternClusterIdx].end(); it++)
+    {
+        patternPoints.push_back(points[*it]);
+    }
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+	The O(n^2) neighbourhood cull of non_max_sup_pts() before the grid:
+	every candidate against every later one. The grid version must
+	invalidate exactly the same candidates
+*/
+
+#ifndef CULL_REFERENCE_H
+#define CULL_REFERENCE_H
+
+#include "non_max_sup_pts.h"
+
+#include <stdlib.h>
+#include <vector>
+
+// same knobs as non_max_sup_pts.cpp
+#define REF_DEGRADE_SHIFT 4
+#define REF_MASS_DEGRADE_SHIFT 5
+
+inline int cull_neighbourhood_ref(int num_found, struct consider_point cp[], char search_size)
+{
+	int invalidated = 0;
+	std::vector<consider_point *> local(num_found > 0 ? num_found : 1);
+
+	for (int i = 0; i < num_found; i++) {
+		int locals = 1;
+		int max = cp[i].max, maxm = cp[i].mass;
+
+		if (!cp[i].valid)
+			continue;
+
+		local[0] = &cp[i];
+
+		for (int t = i + 1; t < num_found; t++) {
+			if (!cp[t].valid)
+				continue;
+			if (abs(cp[i].coord.x - cp[t].coord.x) < search_size &&
+			    abs(cp[i].coord.y - cp[t].coord.y) < search_size) {
+				local[locals++] = &cp[t];
+				if (cp[t].max > max)
+					max = cp[t].max;
+				if (cp[t].mass > maxm)
+					maxm = cp[t].mass;
+			}
+		}
+
+		int sig = max >> REF_DEGRADE_SHIFT;
+		int msig = maxm >> REF_MASS_DEGRADE_SHIFT;
+		for (int l = 0; l < locals; l++)
+			if (local[l]->max < sig || local[l]->mass < msig) {
+				local[l]->valid = false;
+				invalidated++;
+			}
+	}
+
+	return invalidated;
+}
+
+#endif /* CULL_REFERENCE_H */
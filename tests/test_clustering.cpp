@@ -0,0 +1,155 @@
+/*
+	The single linkage clustering on the neighbour graph of CandidateIndex
+	(CirclesGridClusterFinder::hierarchicalClustering()) must give the
+	same cluster as the dense matrix it replaced, with its points in the
+	same order: on clutter around a marker, on lattices where every
+	distance ties, on repeated points, and on masked views of the points
+*/
+
+#include "circlesgrid.hpp"
+#include "clustering_reference.h"
+
+#include <gtest/gtest.h>
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+typedef std::vector<cv::Point2f> Points;
+
+float Uniform(float range)
+{
+	return range * (rand() % 100001) / 100000.f;
+}
+
+// Points shuffled, as the blob detector gives them
+void Shuffle(Points &pts)
+{
+	for (size_t i = pts.size(); i > 1; i--)
+		std::swap(pts[i - 1], pts[rand() % i]);
+}
+
+// 'n' points spread over a 1280x720 frame and the 3x7 asymmetric grid of
+// the marker, spacing 'spacing'
+Points Clutter(int n, float spacing, unsigned seed)
+{
+	srand(seed);
+	Points pts;
+	for (int i = 0; i < n; i++)
+		pts.push_back(cv::Point2f(Uniform(1280), Uniform(720)));
+	const float ox = 200 + Uniform(800), oy = 100 + Uniform(400);
+	for (int i = 0; i < 7; i++)
+		for (int j = 0; j < 3; j++)
+			pts.push_back(cv::Point2f(ox + (2 * j + i % 2) * spacing, oy + i * spacing));
+	Shuffle(pts);
+	return pts;
+}
+
+// 'n' points of a lattice 'width' points wide: every merge is a tie
+Points Lattice(int n, int width, unsigned seed)
+{
+	srand(seed);
+	Points pts;
+	for (int i = 0; i < n; i++)
+		pts.push_back(cv::Point2f((float)(i % width) * 20, (float)(i / width) * 20));
+	Shuffle(pts);
+	return pts;
+}
+
+// 'n' points on the integers of a 'side' x 'side' square: repeated points
+// (zero distances) and ties
+Points Duplicates(int n, int side, unsigned seed)
+{
+	srand(seed);
+	Points pts;
+	for (int i = 0; i < n; i++)
+		pts.push_back(cv::Point2f((float)(rand() % side), (float)(rand() % side)));
+	return pts;
+}
+
+void ExpectSameCluster(const Points &pts, const cv::Size &pattern)
+{
+	Points expected, actual;
+	hierarchicalClusteringRef(pts, pattern, expected);
+	CirclesGridClusterFinder finder(true);
+	finder.hierarchicalClustering(pts, pattern, actual);
+	ASSERT_EQ(expected, actual) << pts.size() << " points, pattern " << pattern.width << "x" << pattern.height;
+}
+
+const cv::Size patterns[] = { cv::Size(3, 7), cv::Size(1, 1), cv::Size(2, 5), cv::Size(1, 2), cv::Size(4, 11) };
+
+TEST(Clustering, ClutterAndMarker)
+{
+	for (int t = 0; t < 40; t++)
+		for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+			ExpectSameCluster(Clutter(1 + t * 4, 10 + t % 7 * 5.f, t), patterns[p]);
+}
+
+TEST(Clustering, TiedLattice)
+{
+	for (int width = 1; width <= 13; width++)
+		for (int n = 20; n <= 200; n += 60)
+			for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+				ExpectSameCluster(Lattice(n, width, n + width), patterns[p]);
+}
+
+TEST(Clustering, RepeatedPoints)
+{
+	const int sides[] = { 2, 5, 40 };
+	for (size_t s = 0; s < sizeof(sides) / sizeof(sides[0]); s++)
+		for (int n = 20; n <= 200; n += 60)
+			for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+				ExpectSameCluster(Duplicates(n, sides[s], n + sides[s]), patterns[p]);
+}
+
+// As many points as the pattern or fewer: all of them or none
+TEST(Clustering, FewPoints)
+{
+	for (int n = 0; n <= 21; n++)
+	{
+		Points pts = Clutter(0, 20, n);
+		pts.resize(n);
+		ExpectSameCluster(pts, cv::Size(3, 7));
+	}
+}
+
+// A masked view of the index clusters the points left, as the dense
+// matrix of those points would; the merges of the whole set are kept
+// across the views
+TEST(Clustering, MaskedViews)
+{
+	const cv::Size pattern(3, 7);
+	for (int t = 0; t < 30; t++)
+	{
+		const Points pts = t % 3 == 0 ? Clutter(40 + t * 7, 15, t) :
+			t % 3 == 1 ? Lattice(60 + t * 3, 1 + t % 9, t) : Duplicates(80, 12, t);
+		CandidateIndex index;
+		index.build(pts);
+
+		for (int view = 0; view < 6; view++)
+		{
+			std::vector<uchar> mask(pts.size());
+			Points left;
+			for (size_t i = 0; i < pts.size(); i++)
+			{
+				mask[i] = view > 0 && rand() % (view + 1) == 0;
+				if (!mask[i])
+					left.push_back(pts[i]);
+			}
+
+			Points expected, actual, whole;
+			hierarchicalClusteringRef(left, pattern, expected);
+			index.cluster(pattern.area(), view > 0 ? &mask : NULL, actual);
+			ASSERT_EQ(expected, actual) << "view " << view << " of " << pts.size() << " points, "
+				<< left.size() << " left";
+
+			hierarchicalClusteringRef(pts, pattern, expected);
+			index.cluster(pattern.area(), NULL, whole);
+			ASSERT_EQ(expected, whole) << "view " << view << " of " << pts.size() << " points";
+		}
+	}
+}
+
+}
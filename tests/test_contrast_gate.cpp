@@ -0,0 +1,119 @@
+/*
+	The contrast gate of ChessDetector skips the response of smooth areas
+	only: on frames of a strip of checker squares over smooth shading, any
+	gate in the useful range finds the same points as no gate
+*/
+
+#include "chess_detector.h"
+
+#include <gtest/gtest.h>
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+// Smooth shading (tissue) and a rotated strip of 8 x 2 checker squares of
+// 'square' pixels (the chess line of the marker), 4x4 supersampled, plus
+// uniform noise of +/- 'noise' grey levels
+cv::Mat RenderFrame(int w, int h, double angle, double square, int dark, int light,
+					double noise, unsigned seed)
+{
+	srand(seed);
+	cv::Mat frame(h, w, CV_8UC1);
+	const double ca = std::cos(angle), sa = std::sin(angle);
+	const double cx = w / 2. + rand() % 40 - 20, cy = h / 2. + rand() % 40 - 20;
+	const int ss = 4;
+	for (int y = 0; y < h; y++)
+	{
+		uchar *row = frame.ptr<uchar>(y);
+		for (int x = 0; x < w; x++)
+		{
+			const double bg = 120 + 50 * std::sin(x * 0.013 + seed) * std::cos(y * 0.011) +
+				20 * std::sin((x + y) * 0.031);
+			double acc = 0;
+			for (int j = 0; j < ss; j++)
+				for (int i = 0; i < ss; i++)
+				{
+					const double px = x + (i + .5) / ss - cx, py = y + (j + .5) / ss - cy;
+					const double u = px * ca + py * sa, v = -px * sa + py * ca;
+					if (std::fabs(u) < square * 4 && std::fabs(v) < square)
+					{
+						const int a = (int)std::floor(u / square) + (int)std::floor(v / square);
+						acc += (a & 1) ? light : dark;
+					}
+					else
+						acc += bg;
+				}
+			const double val = acc / (ss * ss) + noise * ((rand() % 2001) / 1000. - 1);
+			row[x] = (uchar)std::min(255., std::max(0., val));
+		}
+	}
+	return frame;
+}
+
+struct Detection
+{
+	bool found;
+	std::vector<cv::Point2f> points, all_points;
+	size_t skipped;
+};
+
+Detection Detect(const cv::Mat &frame, bool blur, int gate)
+{
+	ChessDetector::Params params;
+	params.blurInput = blur;
+	params.fusedBlur = true;
+	params.contrastGate = gate;
+	ChessDetector detector(params);
+
+	Detection d;
+	d.found = detector.detect(frame, d.points, d.all_points);
+	d.skipped = detector.SkippedPixels();
+	return d;
+}
+
+class ContrastGate : public ::testing::TestWithParam<bool>
+{
+};
+
+TEST_P(ContrastGate, SamePointsAsUngated)
+{
+	const bool blur = GetParam();
+	const int gates[] = { 10, 25, 40 };
+	const size_t n_gates = sizeof(gates) / sizeof(gates[0]);
+	size_t total = 0, skipped[n_gates] = { 0, 0, 0 };
+
+	// squares of 8 to 20 px, contrast 50 to 130, noise up to 8
+	for (int c = 0; c < 12; c++)
+	{
+		const cv::Mat frame = RenderFrame(960, 540, c * 0.37, 8 + (c % 5) * 3,
+			40 + (c % 4) * 15, 40 + (c % 4) * 15 + 50 + (c % 3) * 40, (c % 3) * 4, c + 1);
+
+		const Detection ungated = Detect(frame, blur, 0);
+		EXPECT_EQ(0u, ungated.skipped);
+		total += ungated.all_points.size();
+
+		for (size_t g = 0; g < n_gates; g++)
+		{
+			const Detection gated = Detect(frame, blur, gates[g]);
+			EXPECT_EQ(ungated.found, gated.found) << "frame " << c << ", gate " << gates[g];
+			EXPECT_EQ(ungated.points, gated.points) << "frame " << c << ", gate " << gates[g];
+			EXPECT_EQ(ungated.all_points, gated.all_points) << "frame " << c << ", gate " << gates[g];
+			skipped[g] += gated.skipped;
+		}
+	}
+
+	// the frames have corners to lose, and every gate skips some of the
+	// shading (over all the frames, not necessarily on each)
+	EXPECT_GT(total, 20u);
+	for (size_t g = 0; g < n_gates; g++)
+		EXPECT_GT(skipped[g], 0u) << "gate " << gates[g];
+}
+
+// plain and fused blur kernels
+INSTANTIATE_TEST_CASE_P(Blur, ContrastGate, ::testing::Values(false, true));
+
+}
@@ -0,0 +1,152 @@
+/*
+	Every implementation of the radius 5 ChESS kernel must give the same
+	response as the scalar reference, bit for bit
+*/
+
+#include "corner_detect.h"
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+struct Image
+{
+	size_t w, h;
+	std::vector<uint8_t> pixels;
+};
+
+// Pixels of any grey level
+Image RandomImage(size_t w, size_t h, unsigned seed)
+{
+	Image img = { w, h, std::vector<uint8_t>(w * h) };
+	srand(seed);
+	for (size_t i = 0; i < img.pixels.size(); i++)
+		img.pixels[i] = (uint8_t)(rand() & 0xff);
+	return img;
+}
+
+// Pixels at 0 or 255 only: the largest sums and differences of the ring
+Image HighContrastImage(size_t w, size_t h, unsigned seed)
+{
+	Image img = { w, h, std::vector<uint8_t>(w * h) };
+	srand(seed);
+	for (size_t i = 0; i < img.pixels.size(); i++)
+		img.pixels[i] = (rand() & 1) ? 255 : 0;
+	return img;
+}
+
+// Checkerboard of 'square' pixels, corners at every square
+Image CheckerImage(size_t w, size_t h, size_t square)
+{
+	Image img = { w, h, std::vector<uint8_t>(w * h) };
+	for (size_t y = 0; y < h; y++)
+		for (size_t x = 0; x < w; x++)
+			img.pixels[y * w + x] = ((x / square + y / square) & 1) ? 240 : 15;
+	return img;
+}
+
+const char *ImplName(corner_detect_impl impl)
+{
+	switch (impl) {
+	case CORNER_DETECT_VECTOR:
+		return "vector";
+	case CORNER_DETECT_SSE41:
+		return "SSE4.1";
+	case CORNER_DETECT_AVX2:
+		return "AVX2";
+	default:
+		return "scalar";
+	}
+}
+
+class CornerDetect5 : public ::testing::TestWithParam<corner_detect_impl>
+{
+protected:
+	void SetUp()
+	{
+		std::vector<uint8_t> probe(1);
+		std::vector<int16_t> response(1);
+		if (!corner_detect5_impl(GetParam(), 1, 1, &probe[0], &response[0]))
+			GTEST_SKIP() << ImplName(GetParam()) << " kernel not available on this build/CPU";
+	}
+
+	// Response of the implementation under test against the reference;
+	// the responses are filled with garbage first so that pixels left
+	// unwritten show up
+	void ExpectSameAsReference(const Image &img)
+	{
+		std::vector<int16_t> expected(img.w * img.h, 0x5a5a);
+		std::vector<int16_t> actual(img.w * img.h, -0x5a5b);
+		corner_detect5_ref(img.w, img.h, &img.pixels[0], &expected[0]);
+		ASSERT_TRUE(corner_detect5_impl(GetParam(), img.w, img.h, &img.pixels[0], &actual[0]));
+
+		for (size_t y = 0; y < img.h; y++)
+			for (size_t x = 0; x < img.w; x++)
+				ASSERT_EQ(expected[y * img.w + x], actual[y * img.w + x])
+					<< ImplName(GetParam()) << ", " << img.w << "x" << img.h
+					<< " image, pixel (" << x << ", " << y << ")";
+	}
+};
+
+TEST_P(CornerDetect5, RandomImages)
+{
+	for (unsigned seed = 1; seed <= 8; seed++)
+		ExpectSameAsReference(RandomImage(640, 48, seed));
+}
+
+TEST_P(CornerDetect5, HighContrastImages)
+{
+	for (unsigned seed = 1; seed <= 8; seed++)
+		ExpectSameAsReference(HighContrastImage(640, 48, seed));
+	ExpectSameAsReference(CheckerImage(640, 48, 7));
+}
+
+// Every width from the smallest the ring fits in up to a few vectors, so
+// that each tail length of each kernel is run
+TEST_P(CornerDetect5, OddSizes)
+{
+	for (size_t w = 15; w <= 80; w++)
+		ExpectSameAsReference(RandomImage(w, 15 + w % 7, (unsigned)w));
+	ExpectSameAsReference(HighContrastImage(1023, 31, 5));
+}
+
+// Images the ring does not fit in have a zero response
+TEST_P(CornerDetect5, TinyImages)
+{
+	const size_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 6, 6 }, { 6, 40 }, { 40, 6 }, { 14, 14 }, { 14, 40 }, { 40, 14 } };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		const Image img = RandomImage(sizes[i][0], sizes[i][1], (unsigned)i);
+		ExpectSameAsReference(img);
+
+		std::vector<int16_t> response(img.w * img.h, 1);
+		corner_detect5_impl(GetParam(), img.w, img.h, &img.pixels[0], &response[0]);
+		for (size_t k = 0; k < response.size(); k++)
+			ASSERT_EQ(0, response[k]) << img.w << "x" << img.h << " image";
+	}
+}
+
+INSTANTIATE_TEST_CASE_P(Kernels, CornerDetect5,
+	::testing::Values(CORNER_DETECT_SCALAR, CORNER_DETECT_VECTOR, CORNER_DETECT_SSE41,
+		CORNER_DETECT_AVX2, CORNER_DETECT_AUTO));
+
+// The checkerboard has corners: a reference that only writes zeros would
+// make every comparison above pass
+TEST(CornerDetect5Ref, RespondsToCorners)
+{
+	const Image img = CheckerImage(64, 64, 8);
+	std::vector<int16_t> response(img.w * img.h);
+	corner_detect5_ref(img.w, img.h, &img.pixels[0], &response[0]);
+
+	int16_t max_response = 0;
+	for (size_t k = 0; k < response.size(); k++)
+		max_response = std::max(max_response, response[k]);
+	EXPECT_GT(max_response, 0);
+	EXPECT_GT(response[16 * img.w + 16], response[12 * img.w + 12]);
+}
+
+}
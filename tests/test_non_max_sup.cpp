@@ -0,0 +1,171 @@
+/*
+	The grid neighbourhood cull of non_max_sup_finish() must invalidate the
+	same candidates as the O(n^2) scan it replaced, whatever the spread,
+	clustering and ties of the candidates
+*/
+
+#include "non_max_sup_pts.h"
+#include "chess_features.h"
+#include "cull_reference.h"
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+typedef std::vector<consider_point> Candidates;
+
+consider_point Candidate(int x, int y, int max, int mass)
+{
+	consider_point c;
+	c.valid = true;
+	c.coord.x = x;
+	c.coord.y = y;
+	c.max = (uint16_t)max;
+	c.com.x = (float)x;
+	c.com.y = (float)y;
+	c.mass = mass;
+	return c;
+}
+
+// Candidates spread uniformly over a w x h image
+Candidates Uniform(int n, int w, int h, unsigned seed)
+{
+	srand(seed);
+	Candidates cp;
+	for (int i = 0; i < n; i++)
+		cp.push_back(Candidate(rand() % w, rand() % h, rand() % 2000, rand() % 50000));
+	return cp;
+}
+
+// Tight clusters of candidates with strengths spanning the cull thresholds
+Candidates Clustered(int n, unsigned seed)
+{
+	srand(seed);
+	Candidates cp;
+	for (int i = 0; i < n; i++)
+	{
+		const int cx = 100 + (i / 20) % 10 * 150, cy = 100 + (i / 200) * 150;
+		cp.push_back(Candidate(cx + rand() % 30, cy + rand() % 30,
+			(rand() % 4) ? 1000 + rand() % 100 : rand() % 80,
+			(rand() % 4) ? 20000 + rand() % 100 : rand() % 700));
+	}
+	return cp;
+}
+
+// Strong and weak candidates alternating on a lattice of exactly the
+// neighbourhood size (neighbours of a weak one are just out of reach),
+// weak ones on and just under the thresholds, repeated points and points
+// just within reach: all the equality cases
+Candidates Ties(int search_size)
+{
+	Candidates cp;
+	for (int y = 0; y < 12; y++)
+		for (int x = 0; x < 12; x++)
+		{
+			const int px = x * search_size, py = y * search_size;
+			if ((x + y) % 2 == 0)
+			{
+				cp.push_back(Candidate(px, py, 1600, 32000));
+				continue;
+			}
+			const int k = (x / 2 + y) % 4;
+			cp.push_back(Candidate(px, py, k == 0 ? 100 : k == 1 ? 99 : 1600,
+				k == 2 ? 1000 : k == 3 ? 999 : 32000));
+			if ((x + y) % 3 == 0)
+				cp.push_back(Candidate(px, py, 1600, 32000));
+			else if ((x + y) % 3 == 1 && search_size > 1)
+				cp.push_back(Candidate(px + search_size - 1, py, 1600, 32000));
+		}
+	return cp;
+}
+
+// Cull 'cp' both ways, expect the same candidates kept and the same count
+void ExpectSameCull(const Candidates &cp, char search_size)
+{
+	const int n = (int)cp.size();
+	Candidates expected = cp, actual = cp;
+	const int expected_culled = cull_neighbourhood_ref(n, &expected[0], search_size);
+
+	// room for n candidates and points (an n x 1 image, radius 1)
+	non_max_sup_workspace ws;
+	non_max_sup_reserve(&ws, n, 1, 1, 1);
+	void *points = NULL;
+	ASSERT_TRUE(reserve_point_list(&points, n));
+
+	// with use_com the candidates are localized at their CoM, the
+	// response is not read
+	const int kept = non_max_sup_finish(0, NULL, 0, true, search_size,
+		&actual[0], n, &ws, append_pl_point, points);
+	EXPECT_EQ(n - expected_culled, kept) << n << " candidates, neighbourhood " << (int)search_size;
+	for (int i = 0; i < n; i++)
+		ASSERT_EQ(expected[i].valid, actual[i].valid)
+			<< "candidate " << i << " of " << n << ", neighbourhood " << (int)search_size;
+
+	// survivors are output in candidate order (the count returned also
+	// includes the candidates that were invalid on input)
+	const sized_point_list *list = static_cast<sized_point_list*>(points);
+	int valid = 0;
+	for (int i = 0; i < n; i++)
+		valid += expected[i].valid;
+	ASSERT_EQ(valid, list->occupancy);
+	for (int i = 0, j = 0; i < n; i++)
+		if (expected[i].valid)
+		{
+			EXPECT_EQ(expected[i].com.x + 0.5f, list->point[j].pos.x);
+			EXPECT_EQ(expected[i].com.y + 0.5f, list->point[j].pos.y);
+			j++;
+		}
+	free_point_list(points);
+}
+
+const char search_sizes[] = { 1, 2, 5, 10, 20, 40 };
+
+TEST(CullNeighbourhood, UniformCandidates)
+{
+	const int counts[] = { 1, 2, 10, 50, 300, 1000, 5000 };
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+		for (size_t s = 0; s < sizeof(search_sizes); s++)
+			ExpectSameCull(Uniform(counts[c], 1920, 1080, (unsigned)(c * 7 + s)), search_sizes[s]);
+}
+
+TEST(CullNeighbourhood, ClusteredCandidates)
+{
+	for (size_t s = 0; s < sizeof(search_sizes); s++)
+		for (unsigned seed = 1; seed <= 4; seed++)
+			ExpectSameCull(Clustered(600, seed), search_sizes[s]);
+}
+
+TEST(CullNeighbourhood, TiesAndDuplicates)
+{
+	for (size_t s = 0; s < sizeof(search_sizes); s++)
+		ExpectSameCull(Ties(search_sizes[s]), search_sizes[s]);
+}
+
+// A few candidates far apart make the grid cells grow
+TEST(CullNeighbourhood, SparseCandidates)
+{
+	for (size_t s = 0; s < sizeof(search_sizes); s++)
+	{
+		Candidates cp = Clustered(40, 3);
+		cp.push_back(Candidate(100000, 5, 1800, 40000));
+		cp.push_back(Candidate(5, 70000, 1800, 40000));
+		cp.push_back(Candidate(100000 + search_sizes[s] - 1, 5, 100, 40000));
+		ExpectSameCull(cp, search_sizes[s]);
+	}
+}
+
+// Candidates already invalid stay out of every neighbourhood
+TEST(CullNeighbourhood, InvalidCandidates)
+{
+	for (size_t s = 0; s < sizeof(search_sizes); s++)
+	{
+		Candidates cp = Clustered(400, 9);
+		for (size_t i = 0; i < cp.size(); i += 3)
+			cp[i].valid = false;
+		ExpectSameCull(cp, search_sizes[s]);
+	}
+}
+
+}